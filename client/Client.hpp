@@ -43,6 +43,14 @@ namespace suprpc
                 return _provider->registryMethod(_client->connection(), method, host);
             }
 
+            /**
+             * @brief 注册后连接通常静默，注册中心开启空闲回收时须以小于回收时间的间隔发送心跳
+             */
+            void setHeartbeat(int interval_sec)
+            {
+                _client->setHeartbeat(interval_sec);
+            }
+
         private:
             Requestor::ptr _requestor;
             client::Provider::ptr _provider;
@@ -84,6 +92,14 @@ namespace suprpc
                 return _discoverer->serviceDiscovery(_client->connection(), method, host);
             }
 
+            /**
+             * @brief 发现者平时只等待上下线通知，注册中心开启空闲回收时须以小于回收时间的间隔发送心跳
+             */
+            void setHeartbeat(int interval_sec)
+            {
+                _client->setHeartbeat(interval_sec);
+            }
+
         private:
             Requestor::ptr _requestor;
             client::Discoverer::ptr _discoverer;
@@ -100,6 +116,9 @@ namespace suprpc
         public:
             RpcClient(bool enableDiscovery, const std::string &ip, int port)
                 : _enableDiscovery(enableDiscovery),
+                  _busy_poll_us(0),
+                  _max_frame_size(default_max_frame_size),
+                  _heartbeat_sec(0),
                   _requestor(std::make_shared<Requestor>()),
                   _dispatcher(std::make_shared<Dispatcher>()),
                   _caller(std::make_shared<client::RpcCaller>(_requestor))
@@ -109,6 +128,15 @@ namespace suprpc
                                         _requestor.get(),
                                         std::placeholders::_1, std::placeholders::_2);
                 _dispatcher->registerHandler<BaseMessage>(MType::RSP_RPC, rsp_cb);
+                _dispatcher->registerHandler<BaseMessage>(MType::RSP_RPC_BATCH, rsp_cb);
+                auto stream_cb = std::bind(&client::Requestor::onStreamResponse,
+                                           _requestor.get(),
+                                           std::placeholders::_1, std::placeholders::_2);
+                _dispatcher->registerHandler<BaseMessage>(MType::RSP_RPC_STREAM, stream_cb);
+                auto frame_cb = std::bind(&client::RpcCaller::onStreamFrame,
+                                          _caller.get(),
+                                          std::placeholders::_1, std::placeholders::_2);
+                _dispatcher->registerHandler<StreamFrame>(MType::STREAM_FRAME, frame_cb);
                 if (_enableDiscovery)
                 {
                     auto offline_cb = std::bind(&RpcClient::delClient, this, std::placeholders::_1);
@@ -125,36 +153,211 @@ namespace suprpc
             }
 
             bool call(const std::string &method, const Json::Value &params,
-                      Json::Value &result)
+                      Json::Value &result,
+                      const CallOptions &opts = CallOptions())
+            {
+                BaseClient::ptr client = getClient(method);
+                if (client.get() == nullptr)
+                {
+                    return false;
+                }
+                return _caller->call(client->connection(), method, params, result, opts);
+            }
+
+            bool call(const std::string &method, const Json::Value &params,
+                      RpcCaller::JsonAsyncResponse &result,
+                      const CallOptions &opts = CallOptions())
             {
                 BaseClient::ptr client = getClient(method);
                 if (client.get() == nullptr)
                 {
                     return false;
                 }
-                return _caller->call(client->connection(), method, params, result);
+                return _caller->call(client->connection(), method, params, result, opts);
             }
 
             bool call(const std::string &method, const Json::Value &params,
-                      RpcCaller::JsonAsyncResponse &result)
+                      RpcCaller::JsonResponseCallback &cb,
+                      const CallOptions &opts = CallOptions())
             {
                 BaseClient::ptr client = getClient(method);
                 if (client.get() == nullptr)
                 {
                     return false;
                 }
-                return _caller->call(client->connection(), method, params, result);
+                return _caller->call(client->connection(), method, params, cb, opts);
             }
 
+            /**
+             * @brief 回调形式的调用，超时或出错时以状态码回调on_error
+             */
             bool call(const std::string &method, const Json::Value &params,
-                      RpcCaller::JsonResponseCallback &cb)
+                      const RpcCaller::JsonResponseCallback &cb,
+                      const RpcCaller::ErrorCallback &on_error,
+                      const CallOptions &opts = CallOptions())
+            {
+                BaseClient::ptr client = getClient(method);
+                if (client.get() == nullptr)
+                {
+                    return false;
+                }
+                return _caller->call(client->connection(), method, params, cb, on_error, opts);
+            }
+
+            /**
+             * @brief 批量调用，多个调用合成一帧发出，结果按调用顺序放入results
+             * @details 开启服务发现时按第一个调用的方法选择提供者，批量中的方法需由同一提供者提供
+             */
+            bool batch(const std::vector<BatchCall> &calls,
+                       std::vector<BatchResult> &results,
+                       const CallOptions &opts = CallOptions())
+            {
+                if (calls.empty())
+                {
+                    return false;
+                }
+                BaseClient::ptr client = getClient(calls.front().method);
+                if (client.get() == nullptr)
+                {
+                    return false;
+                }
+                return _caller->batch(client->connection(), calls, results, opts);
+            }
+
+            /**
+             * @brief 流式调用，服务端每写出一个数据帧回调一次on_chunk，结束时回调on_end
+             */
+            bool stream(const std::string &method, const Json::Value &params,
+                        const RpcCaller::JsonStreamCallback &on_chunk,
+                        const RpcCaller::StreamEndCallback &on_end,
+                        const CallOptions &opts = CallOptions())
+            {
+                BaseClient::ptr client = getClient(method);
+                if (client.get() == nullptr)
+                {
+                    return false;
+                }
+                return _caller->stream(client->connection(), method, params, on_chunk, on_end, opts);
+            }
+
+            /**
+             * @brief 流式调用，通过reader逐个读取数据帧，边到达边处理
+             */
+            bool stream(const std::string &method, const Json::Value &params,
+                        StreamReader::ptr &reader,
+                        const CallOptions &opts = CallOptions())
+            {
+                BaseClient::ptr client = getClient(method);
+                if (client.get() == nullptr)
+                {
+                    return false;
+                }
+                return _caller->stream(client->connection(), method, params, reader, opts);
+            }
+
+            /**
+             * @brief 打开双向流，之后通过channel收发数据
+             */
+            bool open(const std::string &method, const Json::Value &params,
+                      StreamChannel::ptr &channel,
+                      const CallOptions &opts = CallOptions())
+            {
+                BaseClient::ptr client = getClient(method);
+                if (client.get() == nullptr)
+                {
+                    return false;
+                }
+                return _caller->open(client->connection(), method, params, channel, opts);
+            }
+
+            /**
+             * @brief 单向调用，不等待也不接收响应
+             */
+            bool notify(const std::string &method, const Json::Value &params,
+                        const CallOptions &opts = CallOptions())
             {
                 BaseClient::ptr client = getClient(method);
                 if (client.get() == nullptr)
                 {
                     return false;
                 }
-                return _caller->call(client->connection(), method, params, cb);
+                return _caller->notify(client->connection(), method, params, opts);
+            }
+
+            /**
+             * @brief 取消一次尚未完成的调用
+             * @param rid 发起调用时在CallOptions中指定的请求id
+             */
+            bool cancel(const std::string &rid)
+            {
+                return _caller->cancel(rid);
+            }
+
+            /**
+             * @brief 开启忙轮询，以CPU换取时延
+             * @details 连接的事件循环在最近一次收发后的spin_us微秒内不再睡眠，
+             *          同步调用在阻塞等待前也先忙等同样长的时间；0表示关闭
+             */
+            void setBusyPoll(int64_t spin_us)
+            {
+                _requestor->setSpinWait(spin_us);
+                std::unique_lock<std::mutex> lock(_mutex);
+                _busy_poll_us = spin_us;
+                if (_rpc_client)
+                    _rpc_client->setBusyPoll(spin_us);
+                for (auto &it : _rpc_clients)
+                {
+                    it.second->setBusyPoll(spin_us);
+                }
+            }
+
+            /**
+             * @brief 设置单个响应报文的长度上限，超过后断开连接
+             */
+            void setMaxFrameSize(size_t size)
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _max_frame_size = size;
+                if (_rpc_client)
+                    _rpc_client->setMaxFrameSize(size);
+                for (auto &it : _rpc_clients)
+                {
+                    it.second->setMaxFrameSize(size);
+                }
+            }
+
+            /**
+             * @brief 各连接空闲interval_sec秒时发送心跳，服务器开启空闲回收时须小于其回收时间；只能设置一次
+             * @details 开启服务发现时同样作用于与注册中心的连接
+             */
+            void setHeartbeat(int interval_sec)
+            {
+                if (_discovery_client)
+                    _discovery_client->setHeartbeat(interval_sec);
+                std::unique_lock<std::mutex> lock(_mutex);
+                _heartbeat_sec = interval_sec;
+                if (_rpc_client)
+                    _rpc_client->setHeartbeat(interval_sec);
+                for (auto &it : _rpc_clients)
+                {
+                    it.second->setHeartbeat(interval_sec);
+                }
+            }
+
+            /**
+             * @brief 将各连接的事件循环线程绑核，按连接建立的顺序依次使用列表中的CPU
+             */
+            void setCpuAffinity(const std::vector<int> &cpus = CpuTopology::instance().defaultLayout())
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cpus = cpus;
+                size_t index = 0;
+                if (_rpc_client)
+                    _rpc_client->setCpuAffinity(Affinity::pick(_cpus, index++));
+                for (auto &it : _rpc_clients)
+                {
+                    it.second->setCpuAffinity(Affinity::pick(_cpus, index++));
+                }
             }
 
         private:
@@ -164,6 +367,13 @@ namespace suprpc
                                             std::placeholders::_1, std::placeholders::_2);
                 auto client = ClientFactory::create(host.first, host.second);
                 client->setMessageCallback(message_cb);
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    client->setBusyPoll(_busy_poll_us);
+                    client->setMaxFrameSize(_max_frame_size);
+                    client->setCpuAffinity(Affinity::pick(_cpus, _rpc_clients.size()));
+                    client->setHeartbeat(_heartbeat_sec);
+                }
                 client->connect();
                 putClient(host, client);
                 return client;
@@ -227,6 +437,10 @@ namespace suprpc
                 }
             };
             bool _enableDiscovery;
+            int64_t _busy_poll_us;
+            size_t _max_frame_size;
+            int _heartbeat_sec;
+            std::vector<int> _cpus;
             DiscoveryClient::ptr _discovery_client;
             Requestor::ptr _requestor;
             RpcCaller::ptr _caller;
@@ -7,6 +7,10 @@
 #include "../common/Message.hpp"
 #include <future>
 #include <functional>
+#include <thread>
+#include <condition_variable>
+#include <map>
+#include <atomic>
 
 namespace suprpc
 {
@@ -20,32 +24,55 @@ namespace suprpc
         {
         public:
             using ptr = std::shared_ptr<Requestor>;
+            // 请求超时未收到响应时，以空消息调用
             using RequestCallback = std::function<void(const BaseMessage::ptr &)>;
             using AsyncResponse = std::future<BaseMessage::ptr>;
+            struct RequestDescribe;
+            using TimeoutMap = std::multimap<std::chrono::steady_clock::time_point, std::shared_ptr<RequestDescribe>>;
             struct RequestDescribe
             {
                 using ptr = std::shared_ptr<RequestDescribe>;
                 BaseMessage::ptr request;
+                BaseConnection::ptr conn;
                 RType rtype;
                 std::promise<BaseMessage::ptr> response;
                 RequestCallback callback;
+                bool timed = false;         // 是否在超时表中，与timeout一起由_timer_mutex保护
+                TimeoutMap::iterator timeout;
             };
 
+            Requestor() : _stop(false), _spin_us(0) {}
+            ~Requestor()
+            {
+                {
+                    std::unique_lock<std::mutex> lock(_timer_mutex);
+                    _stop = true;
+                }
+                _timer_cond.notify_all();
+                if (_timer_thread.joinable())
+                {
+                    _timer_thread.join();
+                }
+            }
+
             void onResponse(const BaseConnection::ptr &conn, BaseMessage::ptr &msg)
             {
                 std::string rid = msg->rid();
-                RequestDescribe::ptr rdp = getDescribe(rid);
+                // 取出即删除，避免与超时处理重复回调
+                RequestDescribe::ptr rdp = takeDescribe(rid);
                 if (rdp.get() == nullptr)
                 {
                     SUP_LOG_ERROR("收到响应 - {}，但是未找到对应的请求描述！", rid);
                     return;
                 }
+                clearTimeout(rdp);
                 if (rdp->rtype == RType::REQ_ASYNC)
                 {
                     rdp->response.set_value(msg);
                 }
-                else if (rdp->rtype == RType::REQ_CALLBACK)
+                else if (rdp->rtype == RType::REQ_CALLBACK || rdp->rtype == RType::REQ_STREAM)
                 {
+                    // 流式调用在开始之前被服务端拒绝时，以普通响应结束
                     if (rdp->callback)
                         rdp->callback(msg);
                 }
@@ -53,14 +80,37 @@ namespace suprpc
                 {
                     SUP_LOG_ERROR("请求类型未知！！！");
                 }
-                delDescribe(rid);
+            }
+
+            /**
+             * @brief 流式响应帧：数据帧保留请求描述，结束帧取出并删除
+             */
+            void onStreamResponse(const BaseConnection::ptr &conn, BaseMessage::ptr &msg)
+            {
+                auto frame = std::dynamic_pointer_cast<RpcStreamResponse>(msg);
+                if (frame.get() == nullptr)
+                {
+                    SUP_LOG_ERROR("流式响应向下类型转换失败！");
+                    return;
+                }
+                std::string rid = msg->rid();
+                RequestDescribe::ptr rdp = frame->eos() ? takeDescribe(rid) : getDescribe(rid);
+                if (rdp.get() == nullptr)
+                {
+                    SUP_LOG_ERROR("收到流式响应 - {}，但是未找到对应的请求描述！", rid);
+                    return;
+                }
+                if (frame->eos())
+                    clearTimeout(rdp);
+                if (rdp->callback)
+                    rdp->callback(msg);
             }
 
             bool send(const BaseConnection::ptr &conn,
                       const BaseMessage::ptr &req,
                       AsyncResponse &async_rsp)
             {
-                RequestDescribe::ptr rdp = newDescribe(req, RType::REQ_ASYNC);
+                RequestDescribe::ptr rdp = newDescribe(conn, req, RType::REQ_ASYNC);
                 if (rdp.get() == nullptr)
                 {
                     SUP_LOG_ERROR("构造请求描述对象失败！");
@@ -72,22 +122,40 @@ namespace suprpc
                 return true;
             }
 
+            /**
+             * @brief 同步请求
+             * @param timeout_ms 等待响应的超时时间，0表示一直等待
+             */
             bool send(const BaseConnection::ptr &conn,
                       const BaseMessage::ptr &req,
-                      BaseMessage::ptr &rsp
+                      BaseMessage::ptr &rsp,
+                      int timeout_ms = 0
                 ){
+                auto start = std::chrono::steady_clock::now();
                 AsyncResponse rsp_future;
                 bool ret = send(conn,req,rsp_future);
                 if(ret == false) return false;
+                spinWait(rsp_future, start);
+                if(timeout_ms > 0 &&
+                    rsp_future.wait_until(start + std::chrono::milliseconds(timeout_ms)) != std::future_status::ready){
+                    SUP_LOG_ERROR("请求 {} 等待响应超时！", req->rid());
+                    cancel(req->rid());
+                    return false;
+                }
                 rsp = rsp_future.get();
                 return true;
             }
                      
+            /**
+             * @brief 回调请求
+             * @param timeout_ms 超时未收到响应时以空消息回调，0表示不限时
+             */
             bool send(const BaseConnection::ptr &conn,
                       const BaseMessage::ptr &req,
-                      const RequestCallback &cb)
+                      const RequestCallback &cb,
+                      int timeout_ms = 0)
             {
-                RequestDescribe::ptr rdp = newDescribe(req, RType::REQ_CALLBACK, cb);
+                RequestDescribe::ptr rdp = newDescribe(conn, req, RType::REQ_CALLBACK, cb);
                 if (rdp.get() == nullptr)
                 {
                     SUP_LOG_ERROR("构造请求数据对象失败!!!");
@@ -95,19 +163,166 @@ namespace suprpc
                 }
                 else
                 {
+                    if (timeout_ms > 0)
+                    {
+                        addTimeout(rdp, timeout_ms);
+                    }
                     conn->send(req);
                     return true;
                 }
             }
 
+            /**
+             * @brief 流式请求，每个响应帧都回调一次
+             * @param timeout_ms 整个流超时未结束时以空消息回调，0表示不限时
+             */
+            bool stream(const BaseConnection::ptr &conn,
+                        const BaseMessage::ptr &req,
+                        const RequestCallback &cb,
+                        int timeout_ms = 0)
+            {
+                RequestDescribe::ptr rdp = newDescribe(conn, req, RType::REQ_STREAM, cb);
+                if (rdp.get() == nullptr)
+                {
+                    SUP_LOG_ERROR("构造请求描述对象失败！");
+                    return false;
+                }
+                if (timeout_ms > 0)
+                {
+                    addTimeout(rdp, timeout_ms);
+                }
+                conn->send(req);
+                return true;
+            }
+
+            /**
+             * @brief 取消一个尚未收到响应的请求，并通知服务端放弃处理
+             * @details 回调不会再被调用；异步等待的future得到broken_promise异常
+             * @return 请求不存在或已完成返回false
+             */
+            bool cancel(const std::string &rid)
+            {
+                RequestDescribe::ptr rdp = takeDescribe(rid);
+                if (rdp.get() == nullptr)
+                {
+                    return false;
+                }
+                clearTimeout(rdp);
+                sendCancel(rdp);
+                return true;
+            }
+
+            /**
+             * @brief 同步请求在阻塞等待前先忙等响应的时间(微秒)，0表示关闭
+             * @details 响应通常在几十微秒内到达时，忙等可以省去一次线程挂起与唤醒
+             */
+            void setSpinWait(int64_t spin_us)
+            {
+                _spin_us.store(spin_us < 0 ? 0 : spin_us, std::memory_order_relaxed);
+            }
+
+            /**
+             * @brief 超时表中尚未到期的请求数
+             */
+            size_t pendingTimeouts()
+            {
+                std::unique_lock<std::mutex> lock(_timer_mutex);
+                return _timeouts.size();
+            }
+
         private:
-            RequestDescribe::ptr newDescribe(const BaseMessage::ptr &req, RType rtype, const RequestCallback &cb = RequestCallback())
+            void spinWait(AsyncResponse &rsp_future, std::chrono::steady_clock::time_point start)
+            {
+                int64_t spin_us = _spin_us.load(std::memory_order_relaxed);
+                if (spin_us == 0)
+                {
+                    return;
+                }
+                auto until = start + std::chrono::microseconds(spin_us);
+                while (rsp_future.wait_for(std::chrono::seconds(0)) != std::future_status::ready &&
+                       std::chrono::steady_clock::now() < until)
+                {
+                }
+            }
+
+            void sendCancel(const RequestDescribe::ptr &rdp)
+            {
+                if (rdp->conn.get() == nullptr || rdp->conn->connected() == false)
+                {
+                    return;
+                }
+                auto msg = MessageFactory::create<CancelRequest>();
+                msg->setId(rdp->request->rid());
+                msg->setMType(MType::REQ_CANCEL);
+                rdp->conn->send(msg);
+            }
+
+            void addTimeout(const RequestDescribe::ptr &rdp, int timeout_ms)
+            {
+                std::unique_lock<std::mutex> lock(_timer_mutex);
+                if (_timer_thread.joinable() == false)
+                {
+                    _timer_thread = std::thread(&Requestor::timerLoop, this);
+                }
+                rdp->timeout = _timeouts.emplace(std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms), rdp);
+                rdp->timed = true;
+                _timer_cond.notify_one();
+            }
+
+            // 请求已应答或已取消：从超时表中删除，不必等到截止时间
+            void clearTimeout(const RequestDescribe::ptr &rdp)
+            {
+                std::unique_lock<std::mutex> lock(_timer_mutex);
+                if (rdp->timed)
+                {
+                    _timeouts.erase(rdp->timeout);
+                    rdp->timed = false;
+                }
+            }
+
+            // 超时线程：按截止时间依次检查，仍未收到响应的请求以空消息回调
+            void timerLoop()
+            {
+                std::unique_lock<std::mutex> lock(_timer_mutex);
+                while (_stop == false)
+                {
+                    if (_timeouts.empty())
+                    {
+                        _timer_cond.wait(lock);
+                        continue;
+                    }
+                    auto it = _timeouts.begin();
+                    if (it->first > std::chrono::steady_clock::now())
+                    {
+                        _timer_cond.wait_until(lock, it->first);
+                        continue;
+                    }
+                    RequestDescribe::ptr expired = it->second;
+                    expired->timed = false;
+                    _timeouts.erase(it);
+                    lock.unlock();
+                    std::string rid = expired->request->rid();
+                    RequestDescribe::ptr rdp = takeDescribe(rid);
+                    if (rdp.get() != nullptr)
+                    {
+                        SUP_LOG_ERROR("请求 {} 等待响应超时！", rid);
+                        sendCancel(rdp);
+                        if (rdp->callback)
+                            rdp->callback(BaseMessage::ptr());
+                    }
+                    lock.lock();
+                }
+            }
+
+            RequestDescribe::ptr newDescribe(const BaseConnection::ptr &conn, const BaseMessage::ptr &req,
+                                             RType rtype, const RequestCallback &cb = RequestCallback())
             {
                 std::unique_lock<std::mutex> lock(_mutex);
                 RequestDescribe::ptr rd = std::make_shared<RequestDescribe>();
                 rd->request = req;
+                rd->conn = conn;
                 rd->rtype = rtype;
-                if (rtype == RType::REQ_CALLBACK && cb)
+                if ((rtype == RType::REQ_CALLBACK || rtype == RType::REQ_STREAM) && cb)
                 {
                     rd->callback = cb;
                 }
@@ -133,9 +348,29 @@ namespace suprpc
                 _request_desc.erase(rid);
             }
 
+            RequestDescribe::ptr takeDescribe(const std::string &rid)
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                auto it = _request_desc.find(rid);
+                if (it == _request_desc.end())
+                {
+                    return RequestDescribe::ptr();
+                }
+                RequestDescribe::ptr rdp = it->second;
+                _request_desc.erase(it);
+                return rdp;
+            }
+
         private:
             std::mutex _mutex;
             std::unordered_map<std::string, RequestDescribe::ptr> _request_desc;
+
+            std::mutex _timer_mutex;
+            std::condition_variable _timer_cond;
+            bool _stop;
+            TimeoutMap _timeouts;
+            std::thread _timer_thread;
+            std::atomic<int64_t> _spin_us;
         };
     }
 }
\ No newline at end of file
@@ -5,9 +5,95 @@
 #pragma once
 #include "Requestor.hpp"
 #include "../common/UuidGen.hpp"
+#include "../common/Stream.hpp"
+#include <stdexcept>
+#include <deque>
 
 namespace suprpc{
     namespace client{
+        /**
+         * @struct CallOptions
+         * @brief 单次rpc调用的可选项
+         */
+        struct CallOptions{
+            int timeout_ms = 0; // 调用超时(毫秒)，0表示不限时；同时作为截止时间预算随请求发往服务端
+            std::string rid;    // 指定请求id以便之后取消，为空时自动生成
+            Priority priority = Priority::NORMAL; // 高优先级的请求与响应越过普通流量，用于小而急的调用
+            std::string tenant; // 租户标签，服务端开启公平调度时按租户分组，为空时按连接分组
+            int stream_window = default_stream_window; // 双向流中客户端的接收窗口(帧数)
+        };
+
+        /**
+         * @struct BatchCall
+         * @brief 批量请求中的一个调用
+         */
+        struct BatchCall{
+            std::string method;
+            Json::Value params;
+        };
+
+        /**
+         * @struct BatchResult
+         * @brief 批量请求中一个调用的结果
+         */
+        struct BatchResult{
+            RCode rcode = RCode::RCODE_OK;
+            Json::Value result;
+        };
+
+        /**
+         * @class StreamReader
+         * @brief 以迭代方式读取流式调用的结果
+         * @details 数据帧在连接的事件循环线程中到达后放入队列，由调用方逐个取出
+         */
+        class StreamReader{
+            public:
+                using ptr = std::shared_ptr<StreamReader>;
+                StreamReader():_ended(false),_rcode(RCode::RCODE_OK){}
+
+                /**
+                 * @brief 阻塞等待下一个数据帧
+                 * @return 流已结束且数据帧已取完时返回false，结果见rcode()
+                 */
+                bool next(Json::Value &chunk){
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _cond.wait(lock,[this](){ return _chunks.empty() == false || _ended; });
+                    if(_chunks.empty()) return false;
+                    chunk = std::move(_chunks.front());
+                    _chunks.pop_front();
+                    return true;
+                }
+
+                // 整个调用的结果，流结束前为RCODE_OK
+                RCode rcode(){
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    return _rcode;
+                }
+
+                void push(const Json::Value &chunk){
+                    {
+                        std::unique_lock<std::mutex> lock(_mutex);
+                        _chunks.push_back(chunk);
+                    }
+                    _cond.notify_one();
+                }
+
+                void end(RCode code){
+                    {
+                        std::unique_lock<std::mutex> lock(_mutex);
+                        _ended = true;
+                        _rcode = code;
+                    }
+                    _cond.notify_all();
+                }
+            private:
+                std::mutex _mutex;
+                std::condition_variable _cond;
+                std::deque<Json::Value> _chunks;
+                bool _ended;
+                RCode _rcode;
+        };
+
         /**
          * @class RpcCaller
          * @brief Rpc调用器类
@@ -17,27 +103,28 @@ namespace suprpc{
                 using ptr = std::shared_ptr<RpcCaller>;
                 using JsonAsyncResponse = std::future<Json::Value>;
                 using JsonResponseCallback = std::function<void (const Json::Value&)>;
+                using JsonStreamCallback = std::function<void (const Json::Value&)>;
+                using StreamEndCallback = std::function<void (RCode)>;
+                using ErrorCallback = std::function<void (RCode)>;
 
                 RpcCaller(const Requestor::ptr &requestor)
-                :_requestor(requestor){}
+                :_requestor(requestor),_streams(std::make_shared<StreamRegistry>()){}
 
                 bool call(
                     const BaseConnection::ptr &conn,
                     const std::string&method,
                     const Json::Value&params,
-                    Json::Value &result){
+                    Json::Value &result,
+                    const CallOptions &opts = CallOptions()){
                         SUP_LOG_DEBUG("开始同步rpc调用...");
+                        if(writable(conn) == false) return false;
                         //1.组织请求
-                        auto req_msg = MessageFactory::create<RpcRequest>();
-                        req_msg->setId(uuid());
-                        req_msg->setMType(MType::REQ_RPC);
-                        req_msg->setMethod(method);
-                        req_msg->setParams(params);
+                        auto req_msg = newRequest(method,params,opts);
                         BaseMessage::ptr rsp_msg;
 
                         //2.发送请求
                         SUP_LOG_DEBUG("开始发送rpc调用请求...");
-                        bool ret = _requestor->send(conn,std::dynamic_pointer_cast<BaseMessage>(req_msg),rsp_msg);
+                        bool ret = _requestor->send(conn,std::dynamic_pointer_cast<BaseMessage>(req_msg),rsp_msg,opts.timeout_ms);
 
                         if(ret == false){
                             SUP_LOG_ERROR("同步Rpc请求失败");
@@ -63,19 +150,17 @@ namespace suprpc{
 
                     bool call(const BaseConnection::ptr &conn,
                         const std::string &method,
-                        const Json::Value &params,JsonAsyncResponse &result){
-                            auto req_msg = MessageFactory::create<RpcRequest>();
-                            req_msg->setId(uuid());
-                            req_msg->setMType(MType::REQ_RPC);
-                            req_msg->setMethod(method);
-                            req_msg->setParams(params);
+                        const Json::Value &params,JsonAsyncResponse &result,
+                        const CallOptions &opts = CallOptions()){
+                            if(writable(conn) == false) return false;
+                            auto req_msg = newRequest(method,params,opts);
 
                             auto json_promise = std::make_shared<std::promise<Json::Value>>();
                             result = json_promise->get_future();
                             Requestor::RequestCallback cb = std::bind(
                                 &RpcCaller::Callback,this,json_promise,std::placeholders::_1
                             );
-                            bool ret = _requestor->send(conn,std::dynamic_pointer_cast<BaseMessage>(req_msg),cb);
+                            bool ret = _requestor->send(conn,std::dynamic_pointer_cast<BaseMessage>(req_msg),cb,opts.timeout_ms);
                             if(ret == false){
                                 SUP_LOG_ERROR("异步Rpc请求失败!");
                                 return false;
@@ -83,40 +168,236 @@ namespace suprpc{
                             return true;
                         }
                 bool call(const BaseConnection::ptr &conn,const std::string&method,
-                    const Json::Value &params,const JsonResponseCallback &cb){
-                        auto req_msg = MessageFactory::create<RpcRequest>();
-                        req_msg->setId(uuid());
-                        req_msg->setMType(MType::REQ_RPC);
-                        req_msg->setMethod(method);
-                        req_msg->setParams(params);
+                    const Json::Value &params,const JsonResponseCallback &cb,
+                    const CallOptions &opts = CallOptions()){
+                        return call(conn,method,params,cb,ErrorCallback(),opts);
+                    }
+                /**
+                 * @brief 回调形式的调用：成功时以结果回调cb，失败时以状态码回调on_error
+                 * @details 超时未应答时以RCODE_TIMEOUT回调on_error，服务端返回的错误码原样传入；
+                 *          两个回调只会有一个被调用，且只调用一次
+                 */
+                bool call(const BaseConnection::ptr &conn,const std::string&method,
+                    const Json::Value &params,const JsonResponseCallback &cb,
+                    const ErrorCallback &on_error,const CallOptions &opts = CallOptions()){
+                        if(writable(conn) == false) return false;
+                        auto req_msg = newRequest(method,params,opts);
 
                         Requestor::RequestCallback req_cb = std::bind(&RpcCaller::Callback_,this,
-                            cb,std::placeholders::_1
+                            cb,on_error,std::placeholders::_1
                         );
-                        bool ret = _requestor->send(conn,std::dynamic_pointer_cast<BaseMessage>(req_msg),req_cb );
+                        bool ret = _requestor->send(conn,std::dynamic_pointer_cast<BaseMessage>(req_msg),req_cb,opts.timeout_ms);
                         if(ret == false){
                             SUP_LOG_ERROR("回调rpc请求失败");
                             return false;
                         }
                         return true;
                     }
+                /**
+                 * @brief 批量调用：多个调用放在一帧中发出，服务端汇集全部结果后一次应答
+                 * @details opts中的超时、优先级与租户作用于每个调用；返回true只表示批量请求本身成功，
+                 *          各调用的状态码见results中对应位置
+                 */
+                bool batch(const BaseConnection::ptr &conn,
+                    const std::vector<BatchCall> &calls,
+                    std::vector<BatchResult> &results,
+                    const CallOptions &opts = CallOptions()){
+                        if(calls.empty()) return false;
+                        if(writable(conn) == false) return false;
+                        auto req_msg = MessageFactory::create<RpcBatchRequest>();
+                        req_msg->setId(opts.rid.empty() ? uuid() : opts.rid);
+                        req_msg->setMType(MType::REQ_RPC_BATCH);
+                        for(auto &call : calls){
+                            req_msg->addCall(call.method,call.params);
+                        }
+                        req_msg->setTimeout(opts.timeout_ms);
+                        req_msg->setPriority(opts.priority);
+                        req_msg->setTenant(opts.tenant);
+                        BaseMessage::ptr rsp_msg;
+                        bool ret = _requestor->send(conn,std::dynamic_pointer_cast<BaseMessage>(req_msg),rsp_msg,opts.timeout_ms);
+                        if(ret == false){
+                            SUP_LOG_ERROR("批量rpc请求失败");
+                            return false;
+                        }
+                        auto batch_rsp = std::dynamic_pointer_cast<RpcBatchResponse>(rsp_msg);
+                        if(!batch_rsp || batch_rsp->rcode() != RCode::RCODE_OK || batch_rsp->size() != calls.size()){
+                            SUP_LOG_ERROR("批量rpc响应错误");
+                            return false;
+                        }
+                        results.clear();
+                        results.resize(calls.size());
+                        for(size_t i = 0; i < calls.size(); ++i){
+                            results[i].rcode = batch_rsp->callRCode(i);
+                            results[i].result = batch_rsp->callResult(i);
+                        }
+                        return true;
+                    }
+
+                /**
+                 * @brief 流式调用：服务端每写出一个数据帧回调一次on_chunk，流结束时以整个调用的结果回调on_end
+                 * @details 回调在连接的事件循环线程中执行；超时未结束时以RCODE_TIMEOUT结束
+                 */
+                bool stream(const BaseConnection::ptr &conn,const std::string&method,
+                    const Json::Value &params,const JsonStreamCallback &on_chunk,
+                    const StreamEndCallback &on_end,const CallOptions &opts = CallOptions()){
+                        if(writable(conn) == false) return false;
+                        auto req_msg = newRequest(method,params,opts);
+                        Requestor::RequestCallback req_cb = std::bind(&RpcCaller::StreamCallback,this,
+                            on_chunk,on_end,std::placeholders::_1
+                        );
+                        bool ret = _requestor->stream(conn,std::dynamic_pointer_cast<BaseMessage>(req_msg),req_cb,opts.timeout_ms);
+                        if(ret == false){
+                            SUP_LOG_ERROR("流式rpc请求失败");
+                            return false;
+                        }
+                        return true;
+                    }
+
+                /**
+                 * @brief 流式调用，通过reader逐个读取数据帧
+                 */
+                bool stream(const BaseConnection::ptr &conn,const std::string&method,
+                    const Json::Value &params,StreamReader::ptr &reader,
+                    const CallOptions &opts = CallOptions()){
+                        auto stream_reader = std::make_shared<StreamReader>();
+                        bool ret = stream(conn,method,params,
+                            [stream_reader](const Json::Value &chunk){ stream_reader->push(chunk); },
+                            [stream_reader](RCode code){ stream_reader->end(code); },
+                            opts);
+                        if(ret == false) return false;
+                        reader = stream_reader;
+                        return true;
+                    }
+
+                /**
+                 * @brief 打开双向流，之后通过channel收发数据，两个方向各自按信用流控
+                 * @details 服务端接受之前本端没有发送信用，write会等待；服务端拒绝时读写都以失败结束，
+                 *          原因见channel->rcode()。用完后close，channel析构时以内部错误结束
+                 */
+                bool open(const BaseConnection::ptr &conn,const std::string&method,
+                    const Json::Value &params,StreamChannel::ptr &channel,
+                    const CallOptions &opts = CallOptions()){
+                        if(conn.get() == nullptr || conn->connected() == false){
+                            SUP_LOG_ERROR("连接已断开，打开双向流失败");
+                            return false;
+                        }
+                        if(writable(conn) == false) return false;
+                        auto req_msg = newRequest(method,params,opts);
+                        int window = opts.stream_window > 0 ? opts.stream_window : default_stream_window;
+                        req_msg->setWindow(window);
+                        auto stream_channel = std::make_shared<StreamChannel>(conn,req_msg->rid(),window,0,opts.priority);
+                        StreamRegistry::ptr streams = _streams;
+                        std::string id = req_msg->rid();
+                        stream_channel->setCompleteCallback([streams,id](RCode){ streams->remove(id); });
+                        _streams->add(conn,stream_channel);
+                        conn->send(req_msg);
+                        channel = stream_channel;
+                        return true;
+                    }
+
+                /**
+                 * @brief 双向流的帧，交给对应的流
+                 */
+                void onStreamFrame(const BaseConnection::ptr &conn,std::shared_ptr<StreamFrame> &frame){
+                    _streams->onFrame(conn,frame);
+                }
+
+                /**
+                 * @brief 单向调用：发出请求即返回，不登记请求描述，服务端执行后也不发送响应
+                 * @details 用于日志、指标上报等不关心结果的调用，帧数与分配次数减半；
+                 *          调用方无从得知请求是否成功执行，opts.timeout_ms只作为服务端的截止时间
+                 */
+                bool notify(const BaseConnection::ptr &conn,const std::string&method,
+                    const Json::Value &params,const CallOptions &opts = CallOptions()){
+                        if(conn.get() == nullptr || conn->connected() == false){
+                            SUP_LOG_ERROR("连接已断开，单向rpc请求失败");
+                            return false;
+                        }
+                        if(writable(conn) == false) return false;
+                        auto req_msg = newRequest(method,params,opts);
+                        req_msg->setOneway(true);
+                        conn->send(req_msg);
+                        return true;
+                    }
+                /**
+                 * @brief 取消一次尚未完成的调用，服务端会丢弃排队中的请求并通知异步处理
+                 * @param rid 发起调用时在CallOptions中指定的请求id
+                 */
+                bool cancel(const std::string &rid){
+                    return _requestor->cancel(rid);
+                }
             private:
-            void Callback_(const JsonResponseCallback &cb,
+            // 连接输出缓冲超过高水位时拒绝新的调用，把背压反馈给调用方
+            bool writable(const BaseConnection::ptr &conn){
+                    if(conn && conn->congested()){
+                        SUP_LOG_WARN("连接输出缓冲拥塞，拒绝本次rpc调用");
+                        return false;
+                    }
+                    return true;
+                }
+
+            RpcRequest::ptr newRequest(const std::string &method,
+                const Json::Value &params,const CallOptions &opts){
+                    auto req_msg = MessageFactory::create<RpcRequest>();
+                    req_msg->setId(opts.rid.empty() ? uuid() : opts.rid);
+                    req_msg->setMType(MType::REQ_RPC);
+                    req_msg->setMethod(method);
+                    req_msg->setParams(params);
+                    req_msg->setTimeout(opts.timeout_ms);
+                    req_msg->setPriority(opts.priority);
+                    req_msg->setTenant(opts.tenant);
+                    return req_msg;
+                }
+
+            void Callback_(const JsonResponseCallback &cb,const ErrorCallback &on_error,
                 const BaseMessage::ptr &msg){
+                    if(!msg){
+                        SUP_LOG_ERROR("回调rpc请求超时");
+                        if(on_error) on_error(RCode::RCODE_TIMEOUT);
+                        return;
+                    }
                     auto rpc_rsp_msg = std::dynamic_pointer_cast<RpcResponse>(msg);
                     if(!rpc_rsp_msg){
                         SUP_LOG_ERROR("rpc响应，向下类型转换失败");
+                        if(on_error) on_error(RCode::RCODE_INVALID_MSG);
                         return;
                     }
                     if(rpc_rsp_msg->rcode() != RCode::RCODE_OK){
-                        SUP_LOG_ERROR("rpc回调请求出错: %s",errReason(rpc_rsp_msg->rcode()));
+                        SUP_LOG_ERROR("rpc回调请求出错: {}",errReason(rpc_rsp_msg->rcode()));
+                        if(on_error) on_error(rpc_rsp_msg->rcode());
                         return;
                     }
                     cb(rpc_rsp_msg->result());
                 }
 
+            void StreamCallback(const JsonStreamCallback &on_chunk,const StreamEndCallback &on_end,
+                const BaseMessage::ptr &msg){
+                    if(!msg){
+                        SUP_LOG_ERROR("流式rpc请求超时");
+                        if(on_end) on_end(RCode::RCODE_TIMEOUT);
+                        return;
+                    }
+                    auto frame = std::dynamic_pointer_cast<RpcStreamResponse>(msg);
+                    if(frame && frame->eos() == false){
+                        if(on_chunk) on_chunk(frame->result());
+                        return;
+                    }
+                    // 结束帧，或流开始之前服务端以普通响应拒绝
+                    auto rpc_rsp_msg = std::dynamic_pointer_cast<RpcResponse>(msg);
+                    RCode code = rpc_rsp_msg ? rpc_rsp_msg->rcode() : RCode::RCODE_INVALID_MSG;
+                    if(code != RCode::RCODE_OK){
+                        SUP_LOG_ERROR("流式rpc请求出错: {}",errReason(code));
+                    }
+                    if(on_end) on_end(code);
+                }
+
             void Callback(std::shared_ptr<std::promise<Json::Value>> result,
                 const BaseMessage::ptr &msg){
+                    if(!msg){
+                        result->set_exception(std::make_exception_ptr(
+                            std::runtime_error(errReason(RCode::RCODE_TIMEOUT))));
+                        return;
+                    }
                     auto rpc_rsp_msg = std::dynamic_pointer_cast<RpcResponse>(msg);
                     if(!rpc_rsp_msg){
                         SUP_LOG_ERROR("rpc响应，向下类型转换失败！");
@@ -130,6 +411,7 @@ namespace suprpc{
                 }
             private:
                 Requestor::ptr _requestor;
+                StreamRegistry::ptr _streams; // 流的结束回调可能晚于调用器析构，共享持有
         };
 
         
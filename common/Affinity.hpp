@@ -0,0 +1,226 @@
+/**
+ * @file Affinity.hpp
+ * @brief CPU拓扑探测与线程绑核
+ */
+#pragma once
+#include "logger.hpp"
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace suprpc
+{
+    /**
+     * @class CpuTopology
+     * @brief 从sysfs读取的CPU拓扑：在线CPU、所属NUMA节点与超线程兄弟
+     */
+    class CpuTopology
+    {
+    public:
+        struct Cpu
+        {
+            int id;
+            int node; // 所属NUMA节点，无法获取时为0
+            int core; // 同一物理核上编号最小的逻辑CPU
+        };
+
+        static const CpuTopology &instance()
+        {
+            static CpuTopology topology;
+            return topology;
+        }
+
+        const std::vector<Cpu> &cpus() const { return _cpus; }
+
+        int nodeOf(int cpu) const
+        {
+            for (auto &c : _cpus)
+            {
+                if (c.id == cpu)
+                    return c.node;
+            }
+            return 0;
+        }
+
+        /**
+         * @brief 拓扑感知的默认绑核顺序
+         * @details 按NUMA节点依次排列，同一节点内先排各物理核的第一个逻辑CPU，再排超线程兄弟。
+         *          顺序分配时相邻线程(如一个分片的事件循环与它的工作线程)落在同一节点的不同物理核上
+         */
+        std::vector<int> defaultLayout() const
+        {
+            std::vector<Cpu> sorted = _cpus;
+            std::stable_sort(sorted.begin(), sorted.end(), [](const Cpu &a, const Cpu &b)
+                             {
+                                 if (a.node != b.node)
+                                     return a.node < b.node;
+                                 bool a_primary = (a.id == a.core), b_primary = (b.id == b.core);
+                                 if (a_primary != b_primary)
+                                     return a_primary;
+                                 return a.id < b.id; });
+            std::vector<int> layout;
+            for (auto &c : sorted)
+            {
+                layout.push_back(c.id);
+            }
+            return layout;
+        }
+
+    private:
+        CpuTopology()
+        {
+            std::vector<int> online = parseList(readFile("/sys/devices/system/cpu/online"));
+            if (online.empty())
+            {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                sched_getaffinity(0, sizeof(set), &set);
+                for (int i = 0; i < CPU_SETSIZE; ++i)
+                {
+                    if (CPU_ISSET(i, &set))
+                        online.push_back(i);
+                }
+            }
+            for (int id : online)
+            {
+                Cpu cpu;
+                cpu.id = id;
+                cpu.node = 0;
+                std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(id);
+                std::vector<int> siblings = parseList(readFile(base + "/topology/thread_siblings_list"));
+                cpu.core = siblings.empty() ? id : siblings.front();
+                for (int node = 0; node < max_nodes; ++node)
+                {
+                    std::ifstream probe(base + "/node" + std::to_string(node));
+                    if (probe.good())
+                    {
+                        cpu.node = node;
+                        break;
+                    }
+                }
+                _cpus.push_back(cpu);
+            }
+        }
+
+        static std::string readFile(const std::string &path)
+        {
+            std::ifstream in(path);
+            std::string content;
+            std::getline(in, content);
+            return content;
+        }
+
+        // 解析"0-3,8,10-11"格式的CPU列表
+        static std::vector<int> parseList(const std::string &list)
+        {
+            std::vector<int> ids;
+            std::stringstream ss(list);
+            std::string range;
+            while (std::getline(ss, range, ','))
+            {
+                if (range.empty())
+                    continue;
+                size_t dash = range.find('-');
+                int first = std::atoi(range.substr(0, dash).c_str());
+                int last = dash == std::string::npos ? first : std::atoi(range.substr(dash + 1).c_str());
+                for (int i = first; i <= last; ++i)
+                {
+                    ids.push_back(i);
+                }
+            }
+            return ids;
+        }
+
+    private:
+        static const int max_nodes = 64;
+        std::vector<Cpu> _cpus;
+    };
+
+    /**
+     * @class Affinity
+     * @brief 线程绑核
+     * @details 内存按首次访问分配在访问线程所在的NUMA节点上，且glibc为各线程分配独立的malloc arena，
+     *          因此线程在创建自身的事件循环、缓冲区等对象之前绑核，即可让这些对象分配在本地节点
+     */
+    class Affinity
+    {
+    public:
+        /**
+         * @brief 将调用线程绑定到指定CPU
+         * @param cpu 小于0表示不绑定
+         */
+        static bool pinCurrentThread(int cpu)
+        {
+            if (cpu < 0)
+            {
+                return true;
+            }
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            if (ret != 0)
+            {
+                SUP_LOG_WARN("线程绑定到CPU {} 失败，错误码 {}", cpu, ret);
+                return false;
+            }
+            SUP_LOG_DEBUG("线程已绑定到CPU {}(NUMA节点 {})", cpu, CpuTopology::instance().nodeOf(cpu));
+            return true;
+        }
+
+        /**
+         * @class ScopedPin
+         * @brief 在作用域内把调用线程绑定到指定CPU，离开作用域时恢复原有的CPU集合
+         * @details 用于借用调用者线程运行的事件循环，事件循环退出后该线程及其之后创建的线程不再受限
+         */
+        class ScopedPin
+        {
+        public:
+            explicit ScopedPin(int cpu) : _saved(false)
+            {
+                if (cpu < 0)
+                {
+                    return;
+                }
+                CPU_ZERO(&_mask);
+                _saved = pthread_getaffinity_np(pthread_self(), sizeof(_mask), &_mask) == 0;
+                if (_saved)
+                {
+                    _saved = pinCurrentThread(cpu);
+                }
+            }
+
+            ~ScopedPin()
+            {
+                if (_saved)
+                {
+                    pthread_setaffinity_np(pthread_self(), sizeof(_mask), &_mask);
+                }
+            }
+
+            ScopedPin(const ScopedPin &) = delete;
+            ScopedPin &operator=(const ScopedPin &) = delete;
+
+        private:
+            cpu_set_t _mask;
+            bool _saved;
+        };
+
+        /**
+         * @brief 从绑核列表中取第index个CPU，列表为空返回-1
+         */
+        static int pick(const std::vector<int> &cpus, size_t index)
+        {
+            if (cpus.empty())
+            {
+                return -1;
+            }
+            return cpus[index % cpus.size()];
+        }
+    };
+}
@@ -1,4 +1,5 @@
 #pragma once 
+#include <atomic>
 #include <memory>
 #include <functional>
 #include "DataTypes.hpp"
@@ -21,6 +22,10 @@ namespace suprpc{
             _mtype = mtype;
         }
         virtual MType mtype () {return _mtype;}
+        virtual void setPriority(const Priority priority){
+            _priority = priority;
+        }
+        virtual Priority priority() {return _priority;}
         virtual std::string serialize() = 0;
         virtual bool deserialize(const std::string& msg) = 0;
         virtual bool check() = 0;
@@ -28,6 +33,7 @@ namespace suprpc{
         private:
         std::string _rid;
         MType _mtype;
+        Priority _priority = Priority::NORMAL;
     };
 
     /**
@@ -68,12 +74,31 @@ namespace suprpc{
         virtual void send(const BaseMessage::ptr &msg) = 0;
         virtual void shutdown() = 0;
         virtual bool connected() = 0;
+        // 输出缓冲超过高水位且尚未写空时为true
+        virtual bool congested() = 0;
+
+        // 连接上尚未结束的请求(含打开的流)，空闲回收不关闭仍有未结束请求的连接
+        virtual void addPending(int delta){
+            _pending_requests.fetch_add(delta, std::memory_order_relaxed);
+        }
+
+        virtual int64_t pending(){
+            return _pending_requests.load(std::memory_order_relaxed);
+        }
+
+        protected:
+            std::atomic<int64_t> _pending_requests{0};
     };
 
     using ConnectionCallback = std::function<void(const BaseConnection::ptr&)>;
     using CloseCallback = std::function<void (const BaseConnection::ptr&)>;
     using MessageCallback = std::function<void (const BaseConnection::ptr&,
             BaseMessage::ptr&)>;
+    using HighWaterMarkCallback = std::function<void (const BaseConnection::ptr&, size_t)>;
+    using WriteCompleteCallback = std::function<void (const BaseConnection::ptr&)>;
+
+    const size_t default_high_water_mark = (64 << 20);
+    const size_t default_max_frame_size = (1 << 16);
     
     /**
      * @class BaseServer
@@ -96,10 +121,50 @@ namespace suprpc{
             _cb_message = cb;
         }
 
+        virtual void setHighWaterMarkCallback(const HighWaterMarkCallback& cb){
+            _cb_high_water_mark = cb;
+        }
+
+        virtual void setWriteCompleteCallback(const WriteCompleteCallback& cb){
+            _cb_write_complete = cb;
+        }
+
+        // 单个连接输出缓冲的高水位，对之后建立的连接生效
+        virtual void setHighWaterMark(size_t mark){
+            _high_water_mark = mark;
+        }
+
+        // 事件循环空闲时忙轮询的时间窗口(微秒)，0表示关闭
+        virtual void setBusyPoll(int64_t spin_us) = 0;
+
+        // 单个报文的长度上限，输入缓冲中未处理完的数据超过该值时断开连接
+        virtual void setMaxFrameSize(size_t size){
+            _max_frame_size = size;
+        }
+
+        // 连接连续timeout_sec秒没有收发且没有未结束的请求时关闭连接，0表示不回收；需在start之前调用。
+        // 平时静默的长连接须由客户端以setHeartbeat保活
+        virtual void setIdleTimeout(int timeout_sec){
+            _idle_timeout_sec = timeout_sec < 0 ? 0 : timeout_sec;
+        }
+
+        // 事件循环线程绑定的CPU，小于0表示不绑定
+        virtual void setCpuAffinity(int cpu) = 0;
+
+        // 停止accept新连接并停止读取所有连接上的新请求，已收到的请求照常处理与应答，可在任意线程调用
+        virtual void drain() = 0;
+        // 退出事件循环，start随之返回，可在任意线程调用
+        virtual void quit() = 0;
+
         protected:
             ConnectionCallback _cb_connection;
             CloseCallback _cb_close;
             MessageCallback _cb_message;
+            HighWaterMarkCallback _cb_high_water_mark;
+            WriteCompleteCallback _cb_write_complete;
+            size_t _high_water_mark = default_high_water_mark;
+            size_t _max_frame_size = default_max_frame_size;
+            int _idle_timeout_sec = 0;
     };
 
     /**
@@ -122,6 +187,31 @@ namespace suprpc{
             _cb_message = cb;
         }
 
+        virtual void setHighWaterMarkCallback(const HighWaterMarkCallback& cb){
+            _cb_high_water_mark = cb;
+        }
+
+        virtual void setWriteCompleteCallback(const WriteCompleteCallback& cb){
+            _cb_write_complete = cb;
+        }
+
+        virtual void setHighWaterMark(size_t mark){
+            _high_water_mark = mark;
+        }
+
+        virtual void setBusyPoll(int64_t spin_us) = 0;
+
+        // 单个报文的长度上限，输入缓冲中未处理完的数据超过该值时断开连接；连接建立后修改对之后收到的数据生效
+        virtual void setMaxFrameSize(size_t size){
+            _max_frame_size = size;
+        }
+
+        // 事件循环线程绑定的CPU，小于0表示不绑定
+        virtual void setCpuAffinity(int cpu) = 0;
+
+        // 连接连续interval_sec秒没有发出数据时发送心跳，使服务端的空闲回收不关闭健康的连接，0表示不发送
+        virtual void setHeartbeat(int interval_sec) = 0;
+
         virtual void connect() = 0;
         virtual void shutdown() = 0;
         virtual bool send(const BaseMessage::ptr&) = 0;
@@ -132,6 +222,10 @@ namespace suprpc{
             ConnectionCallback _cb_connection;
             CloseCallback _cb_close;
             MessageCallback _cb_message;
+            HighWaterMarkCallback _cb_high_water_mark;
+            WriteCompleteCallback _cb_write_complete;
+            size_t _high_water_mark = default_high_water_mark;
+            std::atomic<size_t> _max_frame_size{default_max_frame_size}; // 连接建立后仍可修改，事件循环线程读取
     };
     
 }
\ No newline at end of file
@@ -19,6 +19,16 @@
 #define KEY_HOST_PORT "port"
 #define KEY_RCODE "rcode"
 #define KEY_RESULT "result"
+#define KEY_TIMEOUT "timeout"
+#define KEY_TENANT "tenant"
+#define KEY_ONEWAY "oneway"
+#define KEY_EOS "eos"
+#define KEY_WINDOW "window"
+#define KEY_FRAME "frame"
+#define KEY_DATA "data"
+#define KEY_CREDIT "credit"
+#define KEY_CALLS "calls"
+#define KEY_RESULTS "results"
 
 namespace suprpc
 {
@@ -33,7 +43,13 @@ namespace suprpc
         REQ_TOPIC,
         RSP_TOPIC,
         REQ_SERVICE,
-        RSP_SERVICE
+        RSP_SERVICE,
+        REQ_CANCEL,
+        RSP_RPC_STREAM,
+        STREAM_FRAME,
+        REQ_RPC_BATCH,
+        RSP_RPC_BATCH,
+        HEARTBEAT // 客户端保活，由服务端在传输层消化，没有响应
     };
     /**
      * @class RCode
@@ -50,7 +66,9 @@ namespace suprpc
         RCODE_NOT_FOUND_SERVICE,
         RCODE_INVALID_OPTYPE,
         RCODE_NOT_FOUND_TOPIC,
-        RCODE_INTERNAL_ERROR
+        RCODE_INTERNAL_ERROR,
+        RCODE_TIMEOUT,
+        RCODE_OVERLOADED
     };
 
     /**
@@ -70,7 +88,9 @@ namespace suprpc
             {RCode::RCODE_NOT_FOUND_SERVICE, "找不到对应的服务！"},
             {RCode::RCODE_INVALID_OPTYPE, "无效的操作类型！"},
             {RCode::RCODE_NOT_FOUND_TOPIC, "找不到对应的主题！"},
-            {RCode::RCODE_INTERNAL_ERROR, "内部错误！"}};
+            {RCode::RCODE_INTERNAL_ERROR, "内部错误！"},
+            {RCode::RCODE_TIMEOUT, "请求超时！"},
+            {RCode::RCODE_OVERLOADED, "服务过载！"}};
         auto iter = err_map.find(code);
         if (iter == err_map.end())
         {
@@ -90,7 +110,29 @@ namespace suprpc
     {
         REQ_ASYNC = 0,
         REQ_SYNC,
-        REQ_CALLBACK
+        REQ_CALLBACK,
+        REQ_STREAM
+    };
+
+    /**
+     * @class Priority
+     * @brief 消息优先级，高优先级消息在连接输出与请求排队中越过普通消息
+     */
+    enum class Priority
+    {
+        NORMAL = 0,
+        HIGH
+    };
+
+    /**
+     * @class FrameType
+     * @brief 双向流帧类型
+     */
+    enum class FrameType
+    {
+        DATA = 0, // 数据，消耗发送方一个信用
+        CREDIT,   // 接收方归还的信用
+        END       // 本方向不再有数据，携带状态码
     };
 
     /**
@@ -0,0 +1,400 @@
+/**
+ * @file HotRestart.hpp
+ * @brief 通过Unix套接字在新旧进程之间交接监听套接字
+ */
+#pragma once
+#include "logger.hpp"
+#include <dirent.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace suprpc
+{
+    /**
+     * @class HotRestart
+     * @brief 热重启：旧进程把监听套接字交给新进程，监听队列中的连接不会丢失
+     * @details 交接流程：
+     *          1. 新进程启动时连接交接路径上的Unix套接字，旧进程以SCM_RIGHTS发来全部监听套接字；
+     *          2. 新进程的每个服务器在listen之前，把继承的套接字dup2到自己的Acceptor套接字上，
+     *             此后muduo在继承的套接字上accept；
+     *          3. 旧进程的每个服务器在自己的事件循环中把监听套接字从epoll中移除，不再accept，
+     *             排空已收到的请求后退出。
+     *          muduo不暴露Acceptor的套接字，服务器在构造前后对比/proc/self/fd找出自己的套接字。
+     *          交接路径只允许属主访问，并且只与同一用户的进程交接
+     */
+    class HotRestart
+    {
+    public:
+        using HandoffCallback = std::function<void()>;
+
+        static HotRestart &instance()
+        {
+            static HotRestart hot_restart;
+            return hot_restart;
+        }
+
+        ~HotRestart()
+        {
+            int fd = _serve_fd;
+            if (fd >= 0)
+            {
+                ::shutdown(fd, SHUT_RDWR); // 唤醒阻塞在accept上的交接线程
+            }
+            if (_thread.joinable())
+            {
+                _thread.join();
+            }
+        }
+
+        /**
+         * @brief 新进程：向旧进程索取监听套接字
+         * @return 继承到的套接字个数，没有旧进程时为0
+         */
+        size_t inherit(const std::string &path)
+        {
+            int fd = connectTo(path);
+            if (fd < 0)
+            {
+                SUP_LOG_INFO("{} 上没有可交接的旧进程，正常启动", path);
+                return 0;
+            }
+            if (sameUser(fd) == false)
+            {
+                SUP_LOG_ERROR("{} 上的进程属于其他用户，拒绝交接", path);
+                ::close(fd);
+                return 0;
+            }
+            char req = 'H';
+            std::vector<int> fds;
+            if (::write(fd, &req, 1) == 1)
+            {
+                fds = recvFds(fd);
+            }
+            ::close(fd);
+            std::unique_lock<std::mutex> lock(_mutex);
+            _inherited.insert(_inherited.end(), fds.begin(), fds.end());
+            SUP_LOG_INFO("从旧进程继承了 {} 个监听套接字", fds.size());
+            return fds.size();
+        }
+
+        /**
+         * @brief 新进程：用继承的监听套接字替换服务器自己尚未listen的Acceptor套接字
+         * @param fd 服务器的Acceptor套接字，见createdSocket
+         * @return 没有可用的继承套接字时返回false，此时沿用新建的套接字
+         */
+        bool adopt(int fd)
+        {
+            if (fd < 0)
+            {
+                return false;
+            }
+            int inherited = -1;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (_inherited.empty())
+                {
+                    return false;
+                }
+                inherited = _inherited.back();
+                _inherited.pop_back();
+            }
+            if (::dup2(inherited, fd) < 0)
+            {
+                SUP_LOG_ERROR("替换监听套接字失败: {}", strerror(errno));
+                ::close(inherited);
+                return false;
+            }
+            ::close(inherited);
+            SUP_LOG_INFO("套接字 {} 沿用旧进程的监听套接字", fd);
+            return true;
+        }
+
+        /**
+         * @brief 服务器创建Acceptor期间持有，保证前后对比文件描述符时没有其他服务器在创建套接字
+         */
+        std::mutex &createMutex() { return _create_mutex; }
+
+        /**
+         * @brief 找出before之后新建的、绑定在port上且尚未listen的套接字
+         * @param before 创建Acceptor之前的openFds()
+         * @return 没有找到时返回-1
+         */
+        static int createdSocket(const std::vector<int> &before, uint16_t port)
+        {
+            for (int fd : socketsOnPort(port, false))
+            {
+                if (std::find(before.begin(), before.end(), fd) == before.end())
+                    return fd;
+            }
+            return -1;
+        }
+
+        /**
+         * @brief 旧进程：在后台线程中等待新进程，交出port上的全部监听套接字后调用cb
+         */
+        bool serve(const std::string &path, uint16_t port, const HandoffCallback &cb)
+        {
+            int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd < 0)
+            {
+                SUP_LOG_ERROR("创建交接套接字失败: {}", strerror(errno));
+                return false;
+            }
+            struct sockaddr_un addr;
+            if (fillAddress(path, addr) == false)
+            {
+                ::close(fd);
+                return false;
+            }
+            ::unlink(path.c_str());
+            // listen之前收紧权限，其他用户无法连接交接路径
+            if (::bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+                ::chmod(path.c_str(), 0600) < 0 || ::listen(fd, 1) < 0)
+            {
+                SUP_LOG_ERROR("监听交接路径 {} 失败: {}", path, strerror(errno));
+                ::close(fd);
+                return false;
+            }
+            _serve_fd = fd;
+            _thread = std::thread([this, fd, port, cb]()
+                                  {
+                                      int peer = -1;
+                                      while ((peer = ::accept(fd, nullptr, nullptr)) >= 0 && sameUser(peer) == false)
+                                      {
+                                          SUP_LOG_ERROR("拒绝其他用户的进程索取监听套接字");
+                                          ::close(peer);
+                                      }
+                                      _serve_fd = -1;
+                                      ::close(fd);
+                                      if (peer < 0)
+                                      {
+                                          return;
+                                      }
+                                      char req = 0;
+                                      std::vector<int> fds = socketsOnPort(port, true);
+                                      if (::read(peer, &req, 1) == 1 && sendFds(peer, fds))
+                                      {
+                                          SUP_LOG_INFO("已把 {} 个监听套接字交给新进程", fds.size());
+                                          ::close(peer);
+                                          if (cb)
+                                              cb();
+                                          return;
+                                      }
+                                      SUP_LOG_ERROR("向新进程交接监听套接字失败");
+                                      ::close(peer); });
+            return true;
+        }
+
+        /**
+         * @brief 旧进程：把监听套接字从epoll中移除，不再accept新连接
+         * @details 必须在监听该套接字的事件循环线程中调用，与muduo对epoll的修改互不交错；
+         *          套接字本身仍由新进程持有，不能close或shutdown
+         */
+        static void detachListener(int fd)
+        {
+            for (int epfd : epollFds())
+            {
+                ::epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr); // 不在该epoll中时返回ENOENT，忽略
+            }
+        }
+
+        /**
+         * @brief 查找本进程中绑定在port上的TCP套接字
+         * @param listening 为true时查找已listen的套接字，否则查找尚未listen的
+         */
+        static std::vector<int> socketsOnPort(uint16_t port, bool listening)
+        {
+            std::vector<int> fds;
+            for (int fd : openFds())
+            {
+                struct stat st;
+                if (::fstat(fd, &st) < 0 || S_ISSOCK(st.st_mode) == false)
+                    continue;
+                int type = 0, accepting = 0;
+                socklen_t len = sizeof(type);
+                if (::getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) < 0 || type != SOCK_STREAM)
+                    continue;
+                len = sizeof(accepting);
+                if (::getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &accepting, &len) < 0 ||
+                    (accepting != 0) != listening)
+                    continue;
+                struct sockaddr_storage addr;
+                len = sizeof(addr);
+                if (::getsockname(fd, (struct sockaddr *)&addr, &len) < 0)
+                    continue;
+                uint16_t bound = 0;
+                if (addr.ss_family == AF_INET)
+                    bound = ntohs(((struct sockaddr_in *)&addr)->sin_port);
+                else if (addr.ss_family == AF_INET6)
+                    bound = ntohs(((struct sockaddr_in6 *)&addr)->sin6_port);
+                if (bound != port)
+                    continue;
+                // 已建立的连接同样绑定在该端口上，待监听的套接字没有对端
+                len = sizeof(addr);
+                if (listening == false && ::getpeername(fd, (struct sockaddr *)&addr, &len) == 0)
+                    continue;
+                fds.push_back(fd);
+            }
+            return fds;
+        }
+
+        static std::vector<int> openFds()
+        {
+            std::vector<int> fds;
+            DIR *dir = ::opendir("/proc/self/fd");
+            if (dir == nullptr)
+            {
+                return fds;
+            }
+            int self = ::dirfd(dir);
+            struct dirent *ent;
+            while ((ent = ::readdir(dir)) != nullptr)
+            {
+                if (ent->d_name[0] == '.')
+                    continue;
+                int fd = std::atoi(ent->d_name);
+                if (fd != self)
+                    fds.push_back(fd);
+            }
+            ::closedir(dir);
+            return fds;
+        }
+
+    private:
+        HotRestart() : _serve_fd(-1) {}
+
+        // 对端进程与本进程属于同一有效用户
+        static bool sameUser(int sock)
+        {
+            struct ucred cred;
+            socklen_t len = sizeof(cred);
+            if (::getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+            {
+                return false;
+            }
+            return cred.uid == ::geteuid();
+        }
+
+        static std::vector<int> epollFds()
+        {
+            std::vector<int> fds;
+            char target[64];
+            for (int fd : openFds())
+            {
+                std::string link = "/proc/self/fd/" + std::to_string(fd);
+                ssize_t n = ::readlink(link.c_str(), target, sizeof(target) - 1);
+                if (n <= 0)
+                    continue;
+                target[n] = '\0';
+                if (std::strcmp(target, "anon_inode:[eventpoll]") == 0)
+                    fds.push_back(fd);
+            }
+            return fds;
+        }
+
+        static bool fillAddress(const std::string &path, struct sockaddr_un &addr)
+        {
+            std::memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            if (path.size() >= sizeof(addr.sun_path))
+            {
+                SUP_LOG_ERROR("交接路径 {} 过长", path);
+                return false;
+            }
+            std::memcpy(addr.sun_path, path.c_str(), path.size());
+            return true;
+        }
+
+        static int connectTo(const std::string &path)
+        {
+            struct sockaddr_un addr;
+            if (fillAddress(path, addr) == false)
+            {
+                return -1;
+            }
+            int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd < 0)
+            {
+                return -1;
+            }
+            if (::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+            {
+                ::close(fd);
+                return -1;
+            }
+            return fd;
+        }
+
+        // 一字节的正文携带套接字个数，套接字放在SCM_RIGHTS控制消息中
+        static bool sendFds(int sock, const std::vector<int> &fds)
+        {
+            size_t n = std::min(fds.size(), max_fds);
+            char count = (char)n;
+            struct iovec iov = {&count, 1};
+            std::vector<char> control(CMSG_SPACE(sizeof(int) * max_fds), 0);
+            struct msghdr msg;
+            std::memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            if (n > 0)
+            {
+                msg.msg_control = control.data();
+                msg.msg_controllen = CMSG_SPACE(sizeof(int) * n);
+                struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+                cmsg->cmsg_level = SOL_SOCKET;
+                cmsg->cmsg_type = SCM_RIGHTS;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(int) * n);
+                std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * n);
+            }
+            return ::sendmsg(sock, &msg, 0) == 1;
+        }
+
+        static std::vector<int> recvFds(int sock)
+        {
+            std::vector<int> fds;
+            char count = 0;
+            struct iovec iov = {&count, 1};
+            std::vector<char> control(CMSG_SPACE(sizeof(int) * max_fds), 0);
+            struct msghdr msg;
+            std::memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control.data();
+            msg.msg_controllen = control.size();
+            if (::recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1)
+            {
+                return fds;
+            }
+            for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+            {
+                if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+                    continue;
+                size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                const int *data = (const int *)CMSG_DATA(cmsg);
+                fds.insert(fds.end(), data, data + n);
+            }
+            return fds;
+        }
+
+    private:
+        static constexpr size_t max_fds = 64;
+        std::mutex _mutex; // 保护_inherited
+        std::vector<int> _inherited;
+        std::mutex _create_mutex;
+        std::atomic<int> _serve_fd;
+        std::thread _thread;
+    };
+}
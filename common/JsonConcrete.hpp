@@ -29,9 +29,18 @@ namespace suprpc
             return body;
         }
 
+        // 正文必须是对象，否则各字段的访问会抛出异常；没有字段的消息(如取消请求)正文为null，视为空对象
         virtual bool deserialize(const std::string &msg) override
         {
-            return JSON::deserialize(msg, _body);
+            if (JSON::deserialize(msg, _body) == false)
+            {
+                return false;
+            }
+            if (_body.isNull())
+            {
+                _body = Json::Value(Json::objectValue);
+            }
+            return _body.isObject();
         }
 
     protected:
@@ -0,0 +1,49 @@
+/**
+ * @file MemoryBudget.hpp
+ * @brief 进程级的连接缓冲内存预算
+ */
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace suprpc
+{
+    /**
+     * @class MemoryBudget
+     * @brief 统计所有连接的输入、输出缓冲占用，超出预算时服务端拒绝新请求而不是断开连接
+     */
+    class MemoryBudget
+    {
+    public:
+        static MemoryBudget &instance()
+        {
+            static MemoryBudget budget;
+            return budget;
+        }
+
+        // 预算上限，0表示不限制
+        void setLimit(size_t bytes) { _limit.store(bytes, std::memory_order_relaxed); }
+        size_t limit() { return _limit.load(std::memory_order_relaxed); }
+
+        void add(int64_t delta) { _used.fetch_add(delta, std::memory_order_relaxed); }
+        size_t used()
+        {
+            int64_t used = _used.load(std::memory_order_relaxed);
+            return used < 0 ? 0 : (size_t)used;
+        }
+
+        bool exceeded()
+        {
+            size_t limit = this->limit();
+            return limit > 0 && used() > limit;
+        }
+
+    private:
+        MemoryBudget() : _limit(0), _used(0) {}
+
+    private:
+        std::atomic<size_t> _limit;
+        std::atomic<int64_t> _used;
+    };
+}
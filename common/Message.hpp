@@ -6,6 +6,7 @@
 #include "Base.hpp"
 #include "DataTypes.hpp"
 #include "JsonConcrete.hpp"
+#include <chrono>
 namespace suprpc
 {
     /**
@@ -16,6 +17,9 @@ namespace suprpc
     {
     public:
         using ptr = std::shared_ptr<RpcRequest>;
+        using Clock = std::chrono::steady_clock;
+        // 客户端为发送时刻，服务端为解码时刻，截止时间由此加上剩余预算得到
+        RpcRequest() : _arrival(Clock::now()) {}
         virtual bool check() override
         {
             // rpc请求中，包含请求方法名称（字符串）,参数字段（对象）
@@ -31,11 +35,36 @@ namespace suprpc
                 SUP_LOG_ERROR("RPC请求中没有参数或者参数类型错误！");
                 return false;
             }
+            if (_body[KEY_TIMEOUT].isNull() == false &&
+                _body[KEY_TIMEOUT].isInt() == false)
+            {
+                SUP_LOG_ERROR("RPC请求中超时字段类型错误！");
+                return false;
+            }
+            if (_body[KEY_TENANT].isNull() == false &&
+                _body[KEY_TENANT].isString() == false)
+            {
+                SUP_LOG_ERROR("RPC请求中租户字段类型错误！");
+                return false;
+            }
+            if (_body[KEY_ONEWAY].isNull() == false &&
+                _body[KEY_ONEWAY].isBool() == false)
+            {
+                SUP_LOG_ERROR("RPC请求中单向调用字段类型错误！");
+                return false;
+            }
+            if (_body[KEY_WINDOW].isNull() == false &&
+                _body[KEY_WINDOW].isInt() == false)
+            {
+                SUP_LOG_ERROR("RPC请求中流窗口字段类型错误！");
+                return false;
+            }
             return true;
         }
         std::string method()
         {
-            return _body[KEY_METHOD].asString();
+            const Json::Value &val = _body[KEY_METHOD];
+            return val.isString() ? val.asString() : std::string();
         }
 
         void setMethod(const std::string &method)
@@ -50,6 +79,162 @@ namespace suprpc
         {
             _body[KEY_PARAMS] = params;
         }
+
+        /**
+         * @brief 剩余时间预算，单位毫秒，0表示不限时
+         */
+        int timeout()
+        {
+            const Json::Value &val = _body[KEY_TIMEOUT];
+            return val.isInt() ? val.asInt() : 0;
+        }
+
+        void setTimeout(int timeout_ms)
+        {
+            if (timeout_ms > 0)
+            {
+                _body[KEY_TIMEOUT] = timeout_ms;
+            }
+        }
+
+        /**
+         * @brief 本地截止时间，不限时返回最大时间点
+         */
+        Clock::time_point deadline()
+        {
+            int timeout_ms = timeout();
+            if (timeout_ms <= 0)
+            {
+                return Clock::time_point::max();
+            }
+            return _arrival + std::chrono::milliseconds(timeout_ms);
+        }
+
+        bool expired()
+        {
+            return Clock::now() > deadline();
+        }
+
+        /**
+         * @brief 客户端声明的租户标签，用于服务端公平调度，为空表示未声明
+         */
+        std::string tenant()
+        {
+            const Json::Value &val = _body[KEY_TENANT];
+            return val.isString() ? val.asString() : std::string();
+        }
+
+        void setTenant(const std::string &tenant)
+        {
+            if (tenant.empty() == false)
+            {
+                _body[KEY_TENANT] = tenant;
+            }
+        }
+
+        /**
+         * @brief 单向调用：服务端只执行，不发送响应
+         */
+        bool oneway()
+        {
+            const Json::Value &val = _body[KEY_ONEWAY];
+            return val.isBool() && val.asBool();
+        }
+
+        void setOneway(bool oneway)
+        {
+            if (oneway)
+            {
+                _body[KEY_ONEWAY] = true;
+            }
+        }
+
+        /**
+         * @brief 打开双向流的请求携带客户端的接收窗口(帧数)，普通请求为0
+         */
+        int window()
+        {
+            const Json::Value &val = _body[KEY_WINDOW];
+            return val.isInt() ? val.asInt() : 0;
+        }
+
+        void setWindow(int window)
+        {
+            if (window > 0)
+            {
+                _body[KEY_WINDOW] = window;
+            }
+        }
+
+    private:
+        Clock::time_point _arrival;
+    };
+
+    /**
+     * @class RpcBatchRequest
+     * @brief 批量rpc请求，一帧携带多个调用
+     * @details 超时、租户等选项作用于其中每个调用
+     */
+    class RpcBatchRequest : public RpcRequest
+    {
+    public:
+        using ptr = std::shared_ptr<RpcBatchRequest>;
+        virtual bool check() override
+        {
+            // 单个调用的格式由callValid逐个检查，只影响该调用的应答
+            if (_body[KEY_CALLS].isArray() == false || _body[KEY_CALLS].size() == 0)
+            {
+                SUP_LOG_ERROR("批量RPC请求中没有调用或者调用列表类型错误！");
+                return false;
+            }
+            if (_body[KEY_TIMEOUT].isNull() == false &&
+                _body[KEY_TIMEOUT].isInt() == false)
+            {
+                SUP_LOG_ERROR("批量RPC请求中超时字段类型错误！");
+                return false;
+            }
+            if (_body[KEY_TENANT].isNull() == false &&
+                _body[KEY_TENANT].isString() == false)
+            {
+                SUP_LOG_ERROR("批量RPC请求中租户字段类型错误！");
+                return false;
+            }
+            return true;
+        }
+
+        size_t size()
+        {
+            const Json::Value &calls = _body[KEY_CALLS];
+            return calls.isArray() ? calls.size() : 0;
+        }
+
+        /**
+         * @brief 第index个调用是否为带字符串方法名与对象参数的对象
+         */
+        bool callValid(size_t index)
+        {
+            const Json::Value &call = _body[KEY_CALLS][(Json::ArrayIndex)index];
+            return call.isObject() && call[KEY_METHOD].isString() && call[KEY_PARAMS].isObject();
+        }
+
+        // 以下两个访问函数要求callValid(index)为true
+        std::string callMethod(size_t index)
+        {
+            return _body[KEY_CALLS][(Json::ArrayIndex)index][KEY_METHOD].asString();
+        }
+
+        Json::Value callParams(size_t index)
+        {
+            return _body[KEY_CALLS][(Json::ArrayIndex)index][KEY_PARAMS];
+        }
+
+        void addCall(const std::string &method, const Json::Value &params)
+        {
+            Json::Value call;
+            call[KEY_METHOD] = method;
+            call[KEY_PARAMS] = params;
+            _body[KEY_CALLS].append(call);
+        }
     };
 
     /**
@@ -124,6 +309,8 @@ namespace suprpc
     {
     public:
         using ptr = std::shared_ptr<ServiceRequest>;
+        // 保持普通优先级：旧版本的注册中心不认识带优先级位的消息类型，会断开连接；
+        // 本端发送时按消息类型走加急通道，见 MuduoConnection::urgent
         virtual bool check() override
         {
             if (_body[KEY_METHOD].isNull() == true ||
@@ -190,6 +377,35 @@ namespace suprpc
         }
     };
 
+    /**
+     * @class CancelRequest
+     * @brief 取消请求，消息id即为要取消的请求id，没有响应
+     */
+    class CancelRequest : public JsonRequest
+    {
+    public:
+        using ptr = std::shared_ptr<CancelRequest>;
+        CancelRequest() { setPriority(Priority::HIGH); }
+        virtual bool check() override
+        {
+            return true;
+        }
+    };
+
+    /**
+     * @class Heartbeat
+     * @brief 客户端的心跳，只用于刷新服务端的空闲计时，不交给分发器
+     */
+    class Heartbeat : public JsonRequest
+    {
+    public:
+        using ptr = std::shared_ptr<Heartbeat>;
+        virtual bool check() override
+        {
+            return true;
+        }
+    };
+
     /**
      * @class RpcResponse
      * @brief RPC响应类的实现
@@ -224,6 +440,213 @@ namespace suprpc
         {
             _body[KEY_RESULT] = result;
         }
+
+        virtual std::string serialize() override
+        {
+            if (_serialized.empty() == false)
+            {
+                return _serialized;
+            }
+            return JsonResponse::serialize();
+        }
+
+        /**
+         * @brief 直接使用已序列化的响应正文，发送时不再序列化
+         */
+        void setSerializedBody(const std::string &body)
+        {
+            _serialized = body;
+        }
+
+        /**
+         * @brief 把已序列化的正文解析回字段，之后才能读取状态码与结果
+         */
+        void materialize()
+        {
+            if (_serialized.empty() == false)
+            {
+                deserialize(_serialized);
+                _serialized.clear();
+            }
+        }
+
+    private:
+        std::string _serialized;
+    };
+
+    /**
+     * @class RpcStreamResponse
+     * @brief 流式RPC的响应帧
+     * @details 一次流式调用对应同一请求id的若干数据帧，最后以带结束标记的帧收尾，
+     *          结束帧的状态码即整个调用的结果
+     */
+    class RpcStreamResponse : public RpcResponse
+    {
+    public:
+        using ptr = std::shared_ptr<RpcStreamResponse>;
+        virtual bool check() override
+        {
+            if (_body[KEY_RCODE].isNull() == true ||
+                _body[KEY_RCODE].isIntegral() == false)
+            {
+                SUP_LOG_ERROR("流式RPC响应中无状态码或者状态码类型错误！");
+                return false;
+            }
+            if (_body[KEY_EOS].isNull() == false &&
+                _body[KEY_EOS].isBool() == false)
+            {
+                SUP_LOG_ERROR("流式RPC响应中结束标记类型错误！");
+                return false;
+            }
+            if (eos() == false && _body[KEY_RESULT].isNull() == true)
+            {
+                SUP_LOG_ERROR("流式RPC数据帧中没有结果！");
+                return false;
+            }
+            return true;
+        }
+
+        bool eos()
+        {
+            return _body[KEY_EOS].asBool();
+        }
+
+        void setEos(bool eos)
+        {
+            _body[KEY_EOS] = eos;
+        }
+    };
+
+    /**
+     * @class RpcBatchResponse
+     * @brief 批量rpc响应，按请求中调用的顺序逐个给出状态码与结果
+     */
+    class RpcBatchResponse : public JsonResponse
+    {
+    public:
+        using ptr = std::shared_ptr<RpcBatchResponse>;
+        virtual bool check() override
+        {
+            if (_body[KEY_RCODE].isNull() == true ||
+                _body[KEY_RCODE].isIntegral() == false)
+            {
+                SUP_LOG_ERROR("批量RPC响应中无状态码或者状态码类型错误！");
+                return false;
+            }
+            if (_body[KEY_RESULTS].isNull() == false &&
+                _body[KEY_RESULTS].isArray() == false)
+            {
+                SUP_LOG_ERROR("批量RPC响应中结果列表类型错误！");
+                return false;
+            }
+            return true;
+        }
+
+        size_t size()
+        {
+            const Json::Value &results = _body[KEY_RESULTS];
+            return results.isArray() ? results.size() : 0;
+        }
+
+        // 格式错误的结果项视为解析失败
+        RCode callRCode(size_t index)
+        {
+            const Json::Value &item = resultAt(index);
+            if (item.isObject() == false || item[KEY_RCODE].isInt() == false)
+            {
+                return RCode::RCODE_PARSE_FAILED;
+            }
+            return (RCode)item[KEY_RCODE].asInt();
+        }
+
+        Json::Value callResult(size_t index)
+        {
+            const Json::Value &item = resultAt(index);
+            return item.isObject() ? item[KEY_RESULT] : Json::Value();
+        }
+
+        void addResult(RCode code, const Json::Value &result)
+        {
+            Json::Value item;
+            item[KEY_RCODE] = (int)code;
+            item[KEY_RESULT] = result;
+            _body[KEY_RESULTS].append(item);
+        }
+
+    private:
+        // 越界或结果列表不是数组时返回空值
+        const Json::Value &resultAt(size_t index)
+        {
+            static const Json::Value null_value;
+            const Json::Value &results = _body[KEY_RESULTS];
+            if (results.isArray() == false || index >= results.size())
+            {
+                return null_value;
+            }
+            return results[(Json::ArrayIndex)index];
+        }
+    };
+
+    /**
+     * @class StreamFrame
+     * @brief 双向流的帧，两个方向共用，id为打开流的请求id
+     */
+    class StreamFrame : public JsonResponse
+    {
+    public:
+        using ptr = std::shared_ptr<StreamFrame>;
+        virtual bool check() override
+        {
+            if (_body[KEY_FRAME].isNull() == true ||
+                _body[KEY_FRAME].isInt() == false)
+            {
+                SUP_LOG_ERROR("流帧中无帧类型或者帧类型错误！");
+                return false;
+            }
+            if (frameType() == FrameType::CREDIT &&
+                (_body[KEY_CREDIT].isInt() == false || credit() <= 0))
+            {
+                SUP_LOG_ERROR("信用帧中信用字段错误！");
+                return false;
+            }
+            if (frameType() == FrameType::END &&
+                _body[KEY_RCODE].isInt() == false)
+            {
+                SUP_LOG_ERROR("结束帧中状态码错误！");
+                return false;
+            }
+            return true;
+        }
+
+        FrameType frameType()
+        {
+            return (FrameType)_body[KEY_FRAME].asInt();
+        }
+
+        void setFrameType(FrameType type)
+        {
+            _body[KEY_FRAME] = (int)type;
+        }
+
+        Json::Value data()
+        {
+            return _body[KEY_DATA];
+        }
+
+        void setData(const Json::Value &data)
+        {
+            _body[KEY_DATA] = data;
+        }
+
+        int credit()
+        {
+            return _body[KEY_CREDIT].asInt();
+        }
+
+        void setCredit(int credit)
+        {
+            _body[KEY_CREDIT] = credit;
+        }
     };
 
     /**
@@ -337,6 +760,18 @@ namespace suprpc
                 return std::make_shared<ServiceRequest>();
             case MType::RSP_SERVICE:
                 return std::make_shared<ServiceResponse>();
+            case MType::REQ_CANCEL:
+                return std::make_shared<CancelRequest>();
+            case MType::RSP_RPC_STREAM:
+                return std::make_shared<RpcStreamResponse>();
+            case MType::STREAM_FRAME:
+                return std::make_shared<StreamFrame>();
+            case MType::REQ_RPC_BATCH:
+                return std::make_shared<RpcBatchRequest>();
+            case MType::RSP_RPC_BATCH:
+                return std::make_shared<RpcBatchResponse>();
+            case MType::HEARTBEAT:
+                return std::make_shared<Heartbeat>();
             }
             return BaseMessage::ptr();
         }
@@ -11,14 +11,22 @@
 #include <muduo/base/CountDownLatch.h>
 #include <muduo/net/EventLoopThread.h>
 #include <muduo/net/TcpClient.h>
+#include <boost/any.hpp>
 
 #include "DataTypes.hpp"
 #include "JsonConcrete.hpp"
 #include "logger.hpp"
 #include "Message.hpp"
+#include "Affinity.hpp"
+#include "HotRestart.hpp"
+#include "MemoryBudget.hpp"
 
 #include <mutex>
+#include <atomic>
+#include <chrono>
 #include <unordered_map>
+#include <unordered_set>
+#include <deque>
 
 namespace suprpc
 {
@@ -80,6 +88,7 @@ namespace suprpc
      * @brief Lenth-Value协议类，首部字段表示负载的长度
      * @details | Length | Value |
      *          | Lentgh | mtype | idlen | id    | body  |
+     *          mtype字段低16位为消息类型，16~23位为优先级，普通优先级的报文与旧格式一致
      */
     class LVProtocol : public BaseProtocol
     {
@@ -106,7 +115,9 @@ namespace suprpc
         {
             // 当调用onMessage的时候，默认认为缓冲区的数据足够一条完整的消息
             int32_t total_len = buf->readInt32();
-            MType mtype = (MType)buf->readInt32();
+            int32_t type_field = buf->readInt32();
+            MType mtype = (MType)(type_field & mtypeMask);
+            Priority priority = (Priority)((type_field >> priorityShift) & priorityMask);
             int32_t idlen = buf->readInt32();
             int32_t body_len = total_len - idlen - idlenFieldLength - mtypeFieldLength;
             std::string id = buf->retrieveAsString(idlen);
@@ -126,6 +137,7 @@ namespace suprpc
             }
             msg->setId(id);
             msg->setMType(mtype);
+            msg->setPriority(priority);
             return true;
         }
 
@@ -133,7 +145,7 @@ namespace suprpc
         {
             std::string body = msg->serialize();
             std::string id = msg->rid();
-            auto mtype = htonl((int32_t)msg->mtype());
+            auto mtype = htonl((int32_t)msg->mtype() | ((int32_t)msg->priority() << priorityShift));
             int32_t idlen = htonl(id.size());
             int32_t h_total_len = mtypeFieldLength + idlenFieldLength + id.size() + body.size();
             int32_t n_total_len = htonl(h_total_len);
@@ -151,6 +163,9 @@ namespace suprpc
         const size_t lenFieldsLength = 4;
         const size_t mtypeFieldLength = 4;
         const size_t idlenFieldLength = 4;
+        static const int32_t mtypeMask = 0xffff;
+        static const int32_t priorityShift = 16;
+        static const int32_t priorityMask = 0xff;
     };
 
     /**
@@ -167,21 +182,188 @@ namespace suprpc
         }
     };
 
+    /**
+     * @class TimingWheel
+     * @brief 回收空闲连接的哈希时间轮
+     * @details 时间轮有ticks个槽，事件循环每个tick转动一格并清空转到的槽。连接每次收发时把自己的条目
+     *          放入当前槽，条目的最后一个引用随所在的槽被清空而释放时关闭连接，即连接在ticks个tick内
+     *          没有任何收发就被关闭。仍有未结束请求或打开的流的连接在清空槽时放回当前槽，不会被关闭。
+     *          记录活动与转动都是O(1)，只在事件循环线程中访问
+     */
+    class TimingWheel
+    {
+    public:
+        struct Entry
+        {
+            Entry(const muduo::net::TcpConnectionPtr &conn) : _conn(conn) {}
+            ~Entry()
+            {
+                muduo::net::TcpConnectionPtr conn = _conn.lock();
+                if (conn && conn->connected())
+                {
+                    SUP_LOG_INFO("连接 {} 空闲超时，关闭连接", conn->name());
+                    conn->forceClose();
+                }
+            }
+            // 连接上还有未结束的请求，空闲只是在等待业务处理
+            bool busy() const
+            {
+                muduo::net::TcpConnectionPtr conn = _conn.lock();
+                if (!conn)
+                {
+                    return false;
+                }
+                const BaseConnection::ptr *ctx = boost::any_cast<BaseConnection::ptr>(&conn->getContext());
+                return ctx != nullptr && *ctx && (*ctx)->pending() > 0;
+            }
+            std::weak_ptr<muduo::net::TcpConnection> _conn;
+        };
+        using EntryPtr = std::shared_ptr<Entry>;
+        using WeakEntryPtr = std::weak_ptr<Entry>;
+
+        TimingWheel() : _cursor(0) {}
+
+        // 设置槽数，0表示不回收；需在事件循环开始之前调用
+        void setTicks(size_t ticks)
+        {
+            _slots.assign(ticks, Bucket());
+            _cursor = 0;
+        }
+
+        bool enabled() const { return _slots.empty() == false; }
+
+        /**
+         * @brief 为新连接创建条目并放入当前槽
+         * @return 条目的弱引用，由连接保存，之后每次收发时传给touch
+         */
+        WeakEntryPtr add(const muduo::net::TcpConnectionPtr &conn)
+        {
+            if (enabled() == false)
+            {
+                return WeakEntryPtr();
+            }
+            EntryPtr entry = std::make_shared<Entry>(conn);
+            _slots[_cursor].insert(entry);
+            return entry;
+        }
+
+        void touch(const WeakEntryPtr &weak)
+        {
+            if (enabled() == false)
+            {
+                return;
+            }
+            EntryPtr entry = weak.lock();
+            if (entry)
+            {
+                _slots[_cursor].insert(entry);
+            }
+        }
+
+        void tick()
+        {
+            if (enabled() == false)
+            {
+                return;
+            }
+            _cursor = (_cursor + 1) % _slots.size();
+            Bucket expired;
+            expired.swap(_slots[_cursor]); // 条目析构时关闭连接，先移出再释放
+            for (auto &entry : expired)
+            {
+                if (entry->busy())
+                    _slots[_cursor].insert(entry);
+            }
+        }
+
+    private:
+        using Bucket = std::unordered_set<EntryPtr>;
+        std::vector<Bucket> _slots;
+        size_t _cursor;
+    };
+
     /**
      * @class MuduoConnection
      * @brief Muduo连接对象的封装
+     * @details 发送的报文先追加到连接的输出批次中，由所属事件循环在本轮迭代末尾一次性写出，
+     *          同一次读事件中流水线请求的响应因此合并为一次write。
+     *          输出分为两条通道：高优先级报文每次刷新时全部写出；普通报文只在muduo输出缓冲
+     *          低于bulk_quantum时交给muduo，其余留在连接中，因此高优先级报文不会排在大量已缓冲的
+     *          普通数据之后。留存的普通数据超过高水位时，以与muduo相同的方式回调高水位。
+     *          连接的缓冲占用计入进程级的MemoryBudget，大报文处理完后缓冲收缩回初始大小
      */
-    class MuduoConnection : public BaseConnection
+    class MuduoConnection : public BaseConnection, public std::enable_shared_from_this<MuduoConnection>
     {
     public:
         using ptr = std::shared_ptr<MuduoConnection>;
+        using HighWaterMarkCallback = std::function<void(const muduo::net::TcpConnectionPtr &, size_t)>;
         MuduoConnection(const muduo::net::TcpConnectionPtr &conn,
-                        const BaseProtocol::ptr &protocol) : _conn(conn), _protocol(protocol) {}
+                        const BaseProtocol::ptr &protocol) : _conn(conn), _protocol(protocol), _congested(false), _sent(false),
+                                                             _bulk_bytes(0), _flush_pending(false),
+                                                             _high_water_mark(default_high_water_mark),
+                                                             _above_high_water(false), _accounted(0) {}
+
+        ~MuduoConnection()
+        {
+            MemoryBudget::instance().add(-(int64_t)_accounted);
+        }
+
+        /**
+         * @brief 判断报文是否走本端的加急通道
+         * @details 通道只在本端选择，不依赖报文头部的优先级位：注册发现、取消、心跳与流控信用
+         *          属于控制报文，按消息类型识别即可越过排队的业务数据，同时仍以普通优先级编码，
+         *          旧版本的对端能够正常解析；调用方显式标记为 HIGH 的报文同样走加急通道
+         */
+        static bool urgent(const BaseMessage::ptr &msg)
+        {
+            if (msg->priority() == Priority::HIGH)
+                return true;
+            switch (msg->mtype())
+            {
+            case MType::REQ_SERVICE:
+            case MType::RSP_SERVICE:
+            case MType::REQ_CANCEL:
+            case MType::HEARTBEAT:
+                return true;
+            case MType::STREAM_FRAME:
+            {
+                auto frame = std::dynamic_pointer_cast<StreamFrame>(msg);
+                return frame && frame->frameType() == FrameType::CREDIT;
+            }
+            default:
+                return false;
+            }
+        }
 
         virtual void send(const BaseMessage::ptr &msg) override
         {
             std::string body = _protocol->serialize(msg);
-            _conn->send(body);
+            _sent.store(true, std::memory_order_relaxed);
+            bool schedule = false;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (urgent(msg))
+                {
+                    _urgent.append(body);
+                }
+                else
+                {
+                    _bulk_bytes += body.size();
+                    _bulk.push_back(std::move(body));
+                }
+                if (_flush_pending == false)
+                {
+                    _flush_pending = true;
+                    schedule = true;
+                }
+            }
+            if (schedule)
+            {
+                // 在事件循环线程内调用时，待执行任务会在处理完本轮所有就绪事件后才运行
+                auto self = shared_from_this();
+                _conn->getLoop()->queueInLoop([self]()
+                                              { self->flush(); });
+            }
         }
 
         virtual void shutdown() override
@@ -194,9 +376,141 @@ namespace suprpc
             return _conn->connected();
         }
 
+        virtual bool congested() override
+        {
+            return _congested.load(std::memory_order_relaxed);
+        }
+
+        void setCongested(bool congested)
+        {
+            _congested.store(congested, std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief 上次调用以来是否发出过报文，用于判断是否需要发送心跳
+         */
+        bool takeSent()
+        {
+            return _sent.exchange(false, std::memory_order_relaxed);
+        }
+
+        // 连接建立时在事件循环线程中设置
+        void setHighWaterMarkCallback(const HighWaterMarkCallback &cb, size_t mark)
+        {
+            _cb_high_water_mark = cb;
+            _high_water_mark = mark;
+        }
+
+        // 空闲回收的时间轮条目，只在事件循环线程中访问
+        void setIdleEntry(const TimingWheel::WeakEntryPtr &entry)
+        {
+            _idle_entry = entry;
+        }
+
+        const TimingWheel::WeakEntryPtr &idleEntry() const
+        {
+            return _idle_entry;
+        }
+
+        /**
+         * @brief 留存在连接中尚未交给muduo的普通数据字节数
+         */
+        size_t backlog()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            return _bulk_bytes;
+        }
+
+        /**
+         * @brief 写出输出批次，在事件循环线程中执行，此时TcpConnection::send直接写套接字
+         * @details 除了send投递的刷新，muduo输出缓冲写空时也会调用，继续写出留存的普通数据
+         */
+        void flush()
+        {
+            std::string batch;
+            size_t backlog = 0;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                batch.swap(_urgent);
+                _flush_pending = false;
+                size_t buffered = _conn->outputBuffer()->readableBytes() + batch.size();
+                while (_bulk.empty() == false && buffered < bulk_quantum)
+                {
+                    buffered += _bulk.front().size();
+                    _bulk_bytes -= _bulk.front().size();
+                    batch.append(_bulk.front());
+                    _bulk.pop_front();
+                }
+                backlog = _bulk_bytes;
+            }
+            if (batch.empty() == false)
+            {
+                _conn->send(batch);
+            }
+            // 只在留存数据越过高水位时回调一次，回落到高水位以下后才会再次回调
+            if (backlog <= _high_water_mark)
+            {
+                _above_high_water = false;
+            }
+            else if (_above_high_water == false)
+            {
+                _above_high_water = true;
+                if (_cb_high_water_mark)
+                    _cb_high_water_mark(_conn, backlog);
+            }
+            account();
+        }
+
+        /**
+         * @brief 收缩已读空且容量超过shrink_threshold的muduo缓冲，并重新计入内存预算
+         * @details 在事件循环线程中调用；muduo缓冲只增不减，一次大报文之后会一直占着峰值容量
+         */
+        void reclaim()
+        {
+            muduo::net::Buffer *input = _conn->inputBuffer();
+            if (input->readableBytes() == 0 && input->internalCapacity() > shrink_threshold)
+            {
+                input->shrink(0);
+            }
+            muduo::net::Buffer *output = _conn->outputBuffer();
+            if (output->readableBytes() == 0 && output->internalCapacity() > shrink_threshold)
+            {
+                output->shrink(0);
+            }
+            account();
+        }
+
     private:
+        // 在事件循环线程中调用，把当前缓冲占用与上次计入值的差额计入内存预算
+        void account()
+        {
+            size_t footprint = _conn->inputBuffer()->internalCapacity() +
+                               _conn->outputBuffer()->internalCapacity();
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                footprint += _bulk_bytes + _urgent.size();
+            }
+            MemoryBudget::instance().add((int64_t)footprint - (int64_t)_accounted);
+            _accounted = footprint;
+        }
+
+    private:
+        static const size_t bulk_quantum = (256 << 10);
+        static const size_t shrink_threshold = (64 << 10);
         BaseProtocol::ptr _protocol;
         muduo::net::TcpConnectionPtr _conn;
+        std::atomic<bool> _congested;
+        std::atomic<bool> _sent; // 上次心跳检查以来是否发出过报文
+        std::mutex _mutex; // 保护输出批次
+        std::string _urgent;
+        std::deque<std::string> _bulk;
+        size_t _bulk_bytes;
+        bool _flush_pending;
+        HighWaterMarkCallback _cb_high_water_mark;
+        size_t _high_water_mark;
+        bool _above_high_water; // 留存数据是否已越过高水位，只在事件循环线程中访问
+        size_t _accounted; // 已计入内存预算的字节数，只在事件循环线程中修改
+        TimingWheel::WeakEntryPtr _idle_entry;
     };
 
     /**
@@ -213,6 +527,74 @@ namespace suprpc
         }
     };
 
+    /**
+     * @class BusyPoller
+     * @brief 事件循环的忙轮询模式
+     * @details muduo的epoll_wait超时固定，无法直接改为非阻塞轮询。这里在最近一次收发之后的
+     *          时间窗口内，不断向事件循环投递自身：执行待处理任务期间投递的任务会唤醒eventfd，
+     *          下一轮epoll_wait因此立即返回，事件循环不再睡眠，新数据到达时省去线程唤醒的时延；
+     *          窗口内没有新的活动后停止投递，事件循环恢复阻塞等待
+     */
+    class BusyPoller
+    {
+    public:
+        BusyPoller(muduo::net::EventLoop *loop) : _loop(loop), _window_us(0), _spinning(false),
+                                                  _last_active_us(0), _spins(0) {}
+
+        // 可在任意线程调用，0表示关闭
+        void setWindow(int64_t spin_us)
+        {
+            _window_us.store(spin_us < 0 ? 0 : spin_us, std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief 记录一次收发活动，必要时开始忙轮询，只在事件循环线程中调用
+         */
+        void touch()
+        {
+            if (_window_us.load(std::memory_order_relaxed) == 0)
+            {
+                return;
+            }
+            _last_active_us = nowUs();
+            if (_spinning)
+            {
+                return;
+            }
+            _spinning = true;
+            _loop->queueInLoop(std::bind(&BusyPoller::spin, this));
+        }
+
+        size_t spins() { return _spins.load(std::memory_order_relaxed); }
+
+    private:
+        void spin()
+        {
+            int64_t window = _window_us.load(std::memory_order_relaxed);
+            if (window > 0 && nowUs() - _last_active_us < window)
+            {
+                _spins.fetch_add(1, std::memory_order_relaxed);
+                _loop->queueInLoop(std::bind(&BusyPoller::spin, this));
+                return;
+            }
+            _spinning = false;
+        }
+
+        static int64_t nowUs()
+        {
+            return std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+        }
+
+    private:
+        muduo::net::EventLoop *_loop;
+        std::atomic<int64_t> _window_us;
+        bool _spinning; // 以下两项只在事件循环线程中访问
+        int64_t _last_active_us;
+        std::atomic<size_t> _spins;
+    };
+
     /**
      * @class MuduoServer
      * @brief Muduo服务器类的封装
@@ -221,21 +603,70 @@ namespace suprpc
     {
     public:
         using ptr = std::shared_ptr<MuduoServer>;
-        MuduoServer(uint16_t port) : _server(&_baseloop, muduo::net::InetAddress("0.0.0.0", port),
+        MuduoServer(uint16_t port) : _create_lock(HotRestart::instance().createMutex()),
+                                     _fds_before(HotRestart::openFds()),
+                                     _server(&_baseloop, muduo::net::InetAddress("0.0.0.0", port),
                                              "MuduoServer",
                                              muduo::net::TcpServer::kReusePort),
-                                     _protocol(ProtocolFactory::create())
+                                     _protocol(ProtocolFactory::create()),
+                                     _poller(&_baseloop),
+                                     _cpu(-1),
+                                     _port(port),
+                                     _draining(false)
+        {
+            // muduo不暴露Acceptor的套接字：构造前后对比文件描述符，新出现的待监听套接字即为本服务器的
+            _listen_fd = HotRestart::createdSocket(_fds_before, port);
+            _fds_before.clear();
+            _create_lock.unlock();
+        }
+
+        // 事件循环运行在调用start的线程中，该线程只在事件循环运行期间绑核
+        virtual void setCpuAffinity(int cpu) override
+        {
+            _cpu = cpu;
+        }
+
+        virtual void setBusyPoll(int64_t spin_us) override
         {
+            _poller.setWindow(spin_us);
         }
 
         virtual void start() override
         {
             _server.setConnectionCallback(std::bind(&MuduoServer::onConnection, this, std::placeholders::_1));
             _server.setMessageCallback(std::bind(&MuduoServer::onMessage, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
-            _server.start();  // 先开始监听
+            _server.setWriteCompleteCallback(std::bind(&MuduoServer::onWriteComplete, this, std::placeholders::_1));
+            if (_idle_timeout_sec > 0)
+            {
+                _wheel.setTicks(_idle_timeout_sec);
+                _baseloop.runEvery(idle_tick_sec, std::bind(&TimingWheel::tick, &_wheel));
+            }
+            // 热重启时沿用旧进程交来的监听套接字，必须在listen之前替换
+            HotRestart::instance().adopt(_listen_fd);
+            _server.start(); // 先开始监听
+            Affinity::ScopedPin pin(_cpu);
             _baseloop.loop(); // 开启死循环事件监控
         }
 
+        virtual void drain() override
+        {
+            _baseloop.runInLoop([this]()
+                                {
+                                    _draining = true;
+                                    if (_listen_fd >= 0)
+                                        HotRestart::detachListener(_listen_fd);
+                                    std::unique_lock<std::mutex> lock(_mutex);
+                                    for (auto &it : _conns)
+                                    {
+                                        it.first->stopRead();
+                                    } });
+        }
+
+        virtual void quit() override
+        {
+            _baseloop.quit();
+        }
+
     private:
         void onConnection(const muduo::net::TcpConnectionPtr &conn)
         {
@@ -243,10 +674,19 @@ namespace suprpc
             {
                 SUP_LOG_INFO("连接建立");
                 auto muduo_conn = ConnectionFactory::create(conn, _protocol);
+                // 直接挂到muduo连接的上下文中，消息路径上不再查表加锁
+                conn->setContext(muduo_conn);
+                auto high_water_cb = std::bind(&MuduoServer::onHighWaterMark, this,
+                                               std::placeholders::_1, std::placeholders::_2);
+                conn->setHighWaterMarkCallback(high_water_cb, _high_water_mark);
+                std::static_pointer_cast<MuduoConnection>(muduo_conn)->setHighWaterMarkCallback(high_water_cb, _high_water_mark);
+                std::static_pointer_cast<MuduoConnection>(muduo_conn)->setIdleEntry(_wheel.add(conn));
                 {
                     std::unique_lock<std::mutex> lock(_mutex);
                     _conns.insert(std::make_pair(conn, muduo_conn));
                 }
+                if (_draining)
+                    conn->stopRead();
                 if (_cb_connection)
                     _cb_connection(muduo_conn);
             }
@@ -264,6 +704,7 @@ namespace suprpc
                     muduo_conn = it->second;
                     _conns.erase(conn);
                 }
+                conn->setContext(boost::any());
                 if (_cb_close)
                     _cb_close(muduo_conn);
             }
@@ -274,12 +715,20 @@ namespace suprpc
                        muduo::Timestamp)
         {
             SUP_LOG_DEBUG("开始处理数据");
+            _poller.touch();
+            BaseConnection::ptr base_conn = connectionOf(conn);
+            if (base_conn.get() == nullptr)
+            {
+                conn->shutdown();
+                return;
+            }
+            _wheel.touch(std::static_pointer_cast<MuduoConnection>(base_conn)->idleEntry());
             auto base_buf = BufferFactory::create(buf);
             while (1)
             {
                 if (_protocol->canProcessed(base_buf) == false)
                 {
-                    if (base_buf->readableSize() > max_data_size)
+                    if (base_buf->readableSize() > _max_frame_size)
                     {
                         conn->shutdown();
                         SUP_LOG_ERROR("缓冲区中数据过大");
@@ -298,31 +747,84 @@ namespace suprpc
                     return;
                 }
                 SUP_LOG_TRACE("数据已处理，返回报文为 {}",msg->serialize());
-                BaseConnection::ptr base_conn;
+                if (msg->mtype() == MType::HEARTBEAT)
                 {
-                    std::unique_lock<std::mutex> lock(_mutex);
-                    auto it = _conns.find(conn);
-                    if (it == _conns.end())
-                    {
-                        conn->shutdown();
-                        return;
-                    }
-                    base_conn = it->second;
+                    continue; // 收到报文时已刷新空闲计时
                 }
                 if (_cb_message)
                     _cb_message(base_conn, msg);
             }
+            std::static_pointer_cast<MuduoConnection>(base_conn)->reclaim();
+        }
+
+        // 输出缓冲越过高水位：暂停读取该连接，不再接收新请求，直到缓冲写空
+        void onHighWaterMark(const muduo::net::TcpConnectionPtr &conn, size_t len)
+        {
+            BaseConnection::ptr base_conn = connectionOf(conn);
+            if (base_conn.get() == nullptr)
+            {
+                return;
+            }
+            SUP_LOG_WARN("连接 {} 输出缓冲达到 {} 字节，暂停读取", conn->name(), len);
+            std::static_pointer_cast<MuduoConnection>(base_conn)->setCongested(true);
+            conn->stopRead();
+            if (_cb_high_water_mark)
+                _cb_high_water_mark(base_conn, len);
+        }
+
+        void onWriteComplete(const muduo::net::TcpConnectionPtr &conn)
+        {
+            _poller.touch();
+            BaseConnection::ptr base_conn = connectionOf(conn);
+            if (base_conn.get() == nullptr)
+            {
+                return;
+            }
+            auto muduo_conn = std::static_pointer_cast<MuduoConnection>(base_conn);
+            _wheel.touch(muduo_conn->idleEntry());
+            muduo_conn->flush(); // 继续写出留存的普通数据
+            muduo_conn->reclaim();
+            if (base_conn->congested() && muduo_conn->backlog() == 0 && _draining == false)
+            {
+                SUP_LOG_INFO("连接 {} 输出缓冲已写空，恢复读取", conn->name());
+                std::static_pointer_cast<MuduoConnection>(base_conn)->setCongested(false);
+                conn->startRead();
+            }
+            if (_cb_write_complete)
+                _cb_write_complete(base_conn);
+        }
+
+        /**
+         * @brief 从muduo连接的上下文中取出建立连接时挂载的连接对象
+         * @return 未挂载时返回空指针
+         */
+        static BaseConnection::ptr connectionOf(const muduo::net::TcpConnectionPtr &conn)
+        {
+            const BaseConnection::ptr *ctx = boost::any_cast<BaseConnection::ptr>(&conn->getContext());
+            if (ctx == nullptr)
+            {
+                return BaseConnection::ptr();
+            }
+            return *ctx;
         }
 
         void func() {}
 
     private:
-        const size_t max_data_size = (1 << 16);
+        static constexpr double idle_tick_sec = 1.0; // 时间轮转动一格的间隔
+        std::unique_lock<std::mutex> _create_lock; // 仅在构造期间持有
+        std::vector<int> _fds_before;              // 创建Acceptor之前的文件描述符，仅在构造期间使用
         BaseProtocol::ptr _protocol;
         muduo::net::EventLoop _baseloop;
         muduo::net::TcpServer _server;
-        std::mutex _mutex;
-        std::unordered_map<muduo::net::TcpConnectionPtr, BaseConnection::ptr> _conns;
+        BusyPoller _poller;
+        TimingWheel _wheel; // 只在事件循环线程中访问
+        int _cpu;
+        uint16_t _port;
+        int _listen_fd; // Acceptor的套接字，未找到时为-1
+        bool _draining; // 只在事件循环线程中访问
+        std::mutex _mutex; // 仅保护_conns，消息路径不经过这里
+        std::unordered_map<muduo::net::TcpConnectionPtr, BaseConnection::ptr> _conns; // 仅用于遍历与关闭
     };
 
     /**
@@ -353,6 +855,29 @@ namespace suprpc
               _downlatch(1),
               _client(_baseloop, muduo::net::InetAddress(svr_ip, svr_port), "MuduoClient")
         {
+            _poller.reset(new BusyPoller(_baseloop));
+        }
+
+        virtual void setBusyPoll(int64_t spin_us) override
+        {
+            _poller->setWindow(spin_us);
+        }
+
+        // 事件循环线程在构造时已启动，投递到循环线程中绑核
+        virtual void setCpuAffinity(int cpu) override
+        {
+            _baseloop->runInLoop([cpu]()
+                                 { Affinity::pinCurrentThread(cpu); });
+        }
+
+        // 定时器在事件循环线程中检查，上个周期内发出过报文则不发送心跳；只能设置一次
+        virtual void setHeartbeat(int interval_sec) override
+        {
+            if (interval_sec <= 0)
+            {
+                return;
+            }
+            _baseloop->runEvery(interval_sec, std::bind(&MuduoClient::heartbeat, this));
         }
 
         virtual void connect() override
@@ -363,6 +888,8 @@ namespace suprpc
                                                     std::placeholders::_1));
             _client.setMessageCallback(std::bind(&MuduoClient::onMessage, this,
                                                  std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+            _client.setWriteCompleteCallback(std::bind(&MuduoClient::onWriteComplete, this,
+                                                       std::placeholders::_1));
             _client.connect();
             _downlatch.wait();
             SUP_LOG_INFO("服务器连接成功");
@@ -400,8 +927,13 @@ namespace suprpc
             if (conn->connected())
             {
                 SUP_LOG_TRACE("建立连接！");
+                auto muduo_conn = ConnectionFactory::create(conn, _protocol);
+                auto high_water_cb = std::bind(&MuduoClient::onHighWaterMark, this,
+                                               std::placeholders::_1, std::placeholders::_2);
+                conn->setHighWaterMarkCallback(high_water_cb, _high_water_mark);
+                std::static_pointer_cast<MuduoConnection>(muduo_conn)->setHighWaterMarkCallback(high_water_cb, _high_water_mark);
+                _conn = muduo_conn;
                 _downlatch.countDown();
-                _conn = ConnectionFactory::create(conn, _protocol);
             }
             else
             {
@@ -410,16 +942,65 @@ namespace suprpc
             }
         }
 
+        void heartbeat()
+        {
+            BaseConnection::ptr conn = _conn;
+            if (conn.get() == nullptr || conn->connected() == false)
+            {
+                return;
+            }
+            if (std::static_pointer_cast<MuduoConnection>(conn)->takeSent())
+            {
+                return;
+            }
+            auto msg = MessageFactory::create<Heartbeat>();
+            msg->setMType(MType::HEARTBEAT);
+            conn->send(msg);
+        }
+
+        // 客户端只标记拥塞，由调用方在发起请求前检查并退避
+        void onHighWaterMark(const muduo::net::TcpConnectionPtr &, size_t len)
+        {
+            BaseConnection::ptr conn = _conn;
+            if (conn.get() == nullptr)
+            {
+                return;
+            }
+            SUP_LOG_WARN("客户端输出缓冲达到 {} 字节，进入拥塞状态", len);
+            std::static_pointer_cast<MuduoConnection>(conn)->setCongested(true);
+            if (_cb_high_water_mark)
+                _cb_high_water_mark(conn, len);
+        }
+
+        // 请求写出后响应很快就会到来，从这里开始忙轮询
+        void onWriteComplete(const muduo::net::TcpConnectionPtr &)
+        {
+            _poller->touch();
+            BaseConnection::ptr conn = _conn;
+            if (conn.get() == nullptr)
+            {
+                return;
+            }
+            auto muduo_conn = std::static_pointer_cast<MuduoConnection>(conn);
+            muduo_conn->flush(); // 继续写出留存的普通数据
+            muduo_conn->reclaim();
+            if (muduo_conn->backlog() == 0)
+                muduo_conn->setCongested(false);
+            if (_cb_write_complete)
+                _cb_write_complete(conn);
+        }
+
         void onMessage(const muduo::net::TcpConnectionPtr &conn,
                        muduo::net::Buffer *buf, muduo::Timestamp)
         {
             SUP_LOG_DEBUG("有数据到来，开始处理！");
+            _poller->touch();
             auto base_buf = BufferFactory::create(buf);
             while (1)
             {
                 if (_protocol->canProcessed(base_buf) == false)
                 {
-                    if (base_buf->readableSize() > max_data_size)
+                    if (base_buf->readableSize() > _max_frame_size)
                     {
                         conn->shutdown();
                         SUP_LOG_ERROR("缓冲区数据过大！");
@@ -438,13 +1019,16 @@ namespace suprpc
                 if (_cb_message)
                     _cb_message(_conn, msg);
             }
+            BaseConnection::ptr base_conn = _conn;
+            if (base_conn)
+                std::static_pointer_cast<MuduoConnection>(base_conn)->reclaim();
         }
 
     private:
-        const size_t max_data_size = (1 << 16);
         BaseProtocol::ptr _protocol;
         BaseConnection::ptr _conn;
         muduo::CountDownLatch _downlatch;
+        std::unique_ptr<BusyPoller> _poller; // 先于事件循环线程声明，循环线程退出后才析构
         muduo::net::EventLoopThread _loopthread;
         muduo::net::EventLoop *_baseloop;
         muduo::net::TcpClient _client;
@@ -0,0 +1,391 @@
+/**
+ * @file Stream.hpp
+ * @brief 带信用流控的双向流
+ */
+#pragma once
+#include "Message.hpp"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+
+namespace suprpc
+{
+    // 双向流默认的接收窗口(帧数)
+    const int default_stream_window = 64;
+
+    /**
+     * @class StreamChannel
+     * @brief 双向流的一端，客户端与服务端共用
+     * @details 两个方向各自按信用流控：发送方的信用初始为接收方的窗口，每发一个数据帧消耗一个，
+     *          信用耗尽时write阻塞；接收方每被read取走半个窗口的数据，就把对应的信用还给发送方。
+     *          任一方向在途与缓存的数据帧因此都不超过接收方的窗口，生产者无法压垮对端。
+     *          本端close且收到对端的结束帧、本端以错误码close或对象析构时，调用一次结束回调。
+     *          read与write会阻塞，不要在事件循环线程中调用
+     */
+    class StreamChannel
+    {
+    public:
+        using ptr = std::shared_ptr<StreamChannel>;
+        using CompleteCallback = std::function<void(RCode)>;
+
+        /**
+         * @param window 本端的接收窗口
+         * @param credit 初始发送信用，即对端已声明的接收窗口
+         */
+        StreamChannel(const BaseConnection::ptr &conn, const std::string &id,
+                      int window, int credit, Priority priority = Priority::NORMAL)
+            : _conn(conn), _id(id), _window(window < 1 ? 1 : window), _credit(credit), _consumed(0),
+              _priority(priority), _write_closed(false), _read_closed(false), _completed(false),
+              _rcode(RCode::RCODE_OK), _close_code(RCode::RCODE_OK) {}
+
+        ~StreamChannel()
+        {
+            close(RCode::RCODE_INTERNAL_ERROR);
+            complete();
+        }
+
+        const std::string &id() { return _id; }
+
+        // 在流开始收发之前设置
+        void setCompleteCallback(const CompleteCallback &cb)
+        {
+            _callback = cb;
+        }
+
+        /**
+         * @brief 接受对端打开的流：把本端的接收窗口作为初始信用发给对端
+         * @details 打开方的窗口随打开请求发出，不需要调用
+         */
+        void accept()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            sendFrame(FrameType::CREDIT, Json::Value(), _window, RCode::RCODE_OK, Priority::HIGH);
+        }
+
+        /**
+         * @brief 发出一个数据帧，没有信用时阻塞等待
+         * @return 本端已close、对端以错误码结束或连接已断开时返回false
+         */
+        bool write(const Json::Value &data)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (_credit == 0 && aborted() == false)
+            {
+                _cond.wait_for(lock, std::chrono::milliseconds(poll_interval_ms));
+            }
+            if (aborted())
+            {
+                return false;
+            }
+            --_credit;
+            sendFrame(FrameType::DATA, data, 0, RCode::RCODE_OK, _priority);
+            return true;
+        }
+
+        /**
+         * @brief 不阻塞的write，没有信用时直接返回false
+         */
+        bool tryWrite(const Json::Value &data)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_credit == 0 || aborted())
+            {
+                return false;
+            }
+            --_credit;
+            sendFrame(FrameType::DATA, data, 0, RCode::RCODE_OK, _priority);
+            return true;
+        }
+
+        /**
+         * @brief 取出对端发来的下一个数据帧，暂无数据时阻塞等待
+         * @return 对端已结束且数据已取完，或连接已断开时返回false，对端的结果见rcode()
+         */
+        bool read(Json::Value &data)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (_inbox.empty() && _read_closed == false)
+            {
+                if (_conn->connected() == false)
+                {
+                    _read_closed = true;
+                    _rcode = RCode::RCODE_DISCONNECTED;
+                    break;
+                }
+                _cond.wait_for(lock, std::chrono::milliseconds(poll_interval_ms));
+            }
+            if (_inbox.empty())
+            {
+                return false;
+            }
+            data = std::move(_inbox.front());
+            _inbox.pop_front();
+            // 攒够半个窗口再归还，减少信用帧；信用帧走高优先级通道，不排在数据之后
+            if (++_consumed >= (_window + 1) / 2 && _read_closed == false)
+            {
+                sendFrame(FrameType::CREDIT, Json::Value(), _consumed, RCode::RCODE_OK, Priority::HIGH);
+                _consumed = 0;
+            }
+            return true;
+        }
+
+        /**
+         * @brief 结束本端的写方向，对端读完已发出的数据后得到code
+         * @details 以错误码结束时视为放弃整个流，不再等待对端的结束帧
+         * @return 已经结束过则返回false
+         */
+        bool close(RCode code = RCode::RCODE_OK)
+        {
+            bool done = false;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (_write_closed)
+                {
+                    return false;
+                }
+                _write_closed = true;
+                _close_code = code;
+                if (_conn->connected())
+                {
+                    sendFrame(FrameType::END, Json::Value(), 0, code, _priority);
+                }
+                done = _read_closed || code != RCode::RCODE_OK;
+            }
+            _cond.notify_all();
+            if (done)
+            {
+                complete();
+            }
+            return true;
+        }
+
+        /**
+         * @brief 对端结束写方向时的状态码，尚未结束时为RCODE_OK
+         */
+        RCode rcode()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            return _rcode;
+        }
+
+        /**
+         * @brief 剩余的发送信用
+         */
+        int credit()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            return _credit;
+        }
+
+        /**
+         * @brief 处理对端发来的帧，在事件循环线程中调用
+         * @details 格式错误、超出信用的数据帧与非法的信用值都是协议错误，
+         *          此时以RCODE_INVALID_MSG结束整个流，双方都能得知
+         */
+        void onFrame(const StreamFrame::ptr &frame)
+        {
+            bool done = false;
+            bool violated = false;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (frame->check() == false)
+                {
+                    SUP_LOG_ERROR("流 {} 收到格式错误的帧", _id);
+                    violated = true;
+                }
+                else
+                {
+                    switch (frame->frameType())
+                    {
+                    case FrameType::DATA:
+                        if (_read_closed)
+                        {
+                            break;
+                        }
+                        if (_inbox.size() >= (size_t)_window)
+                        {
+                            SUP_LOG_ERROR("流 {} 的对端超出信用发送数据", _id);
+                            violated = true;
+                            break;
+                        }
+                        _inbox.push_back(frame->data());
+                        break;
+                    case FrameType::CREDIT:
+                        if (frame->credit() > std::numeric_limits<int>::max() - _credit)
+                        {
+                            SUP_LOG_ERROR("流 {} 的对端归还的信用溢出", _id);
+                            violated = true;
+                            break;
+                        }
+                        _credit += frame->credit();
+                        break;
+                    case FrameType::END:
+                        _read_closed = true;
+                        _rcode = frame->rcode();
+                        done = _write_closed;
+                        break;
+                    default:
+                        SUP_LOG_ERROR("流 {} 收到未知类型的帧", _id);
+                        violated = true;
+                        break;
+                    }
+                }
+                if (violated)
+                {
+                    // 不再接收对端的数据；本端已结束写方向时由这里完成
+                    _read_closed = true;
+                    _rcode = RCode::RCODE_INVALID_MSG;
+                    if (_write_closed)
+                        _close_code = RCode::RCODE_INVALID_MSG;
+                }
+            }
+            _cond.notify_all();
+            if (violated)
+            {
+                if (close(RCode::RCODE_INVALID_MSG) == false)
+                    complete();
+                return;
+            }
+            if (done)
+            {
+                complete();
+            }
+        }
+
+        /**
+         * @brief 在流建立之前拒绝，直接发出结束帧
+         */
+        static void reject(const BaseConnection::ptr &conn, const std::string &id,
+                           RCode code, Priority priority = Priority::NORMAL)
+        {
+            conn->send(newFrame(id, FrameType::END, Json::Value(), 0, code, priority));
+        }
+
+    private:
+        // 持锁调用，保证帧的发出顺序与状态变化一致
+        void sendFrame(FrameType type, const Json::Value &data, int credit, RCode code, Priority priority)
+        {
+            _conn->send(newFrame(_id, type, data, credit, code, priority));
+        }
+
+        static StreamFrame::ptr newFrame(const std::string &id, FrameType type, const Json::Value &data,
+                                         int credit, RCode code, Priority priority)
+        {
+            auto frame = MessageFactory::create<StreamFrame>();
+            frame->setId(id);
+            frame->setMType(MType::STREAM_FRAME);
+            frame->setFrameType(type);
+            if (type == FrameType::DATA)
+                frame->setData(data);
+            else if (type == FrameType::CREDIT)
+                frame->setCredit(credit);
+            else
+                frame->setRCode(code);
+            frame->setPriority(priority);
+            return frame;
+        }
+
+        // 持锁调用：写方向已不可用
+        bool aborted()
+        {
+            return _write_closed || (_read_closed && _rcode != RCode::RCODE_OK) || _conn->connected() == false;
+        }
+
+        void complete()
+        {
+            CompleteCallback cb;
+            RCode code;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (_completed)
+                {
+                    return;
+                }
+                _completed = true;
+                cb.swap(_callback);
+                code = _close_code;
+            }
+            if (cb)
+                cb(code);
+        }
+
+    private:
+        static constexpr int poll_interval_ms = 100; // 阻塞等待时检查连接状态的间隔
+        BaseConnection::ptr _conn;
+        std::string _id;
+        int _window;
+        std::mutex _mutex;
+        std::condition_variable _cond;
+        int _credit;                    // 剩余发送信用
+        int _consumed;                  // 已取走而尚未归还信用的帧数
+        Priority _priority;
+        std::deque<Json::Value> _inbox; // 已收到而尚未取走的数据，不超过_window
+        bool _write_closed;
+        bool _read_closed;
+        bool _completed;
+        RCode _rcode;      // 对端结束时的状态码
+        RCode _close_code; // 本端结束时的状态码
+        CompleteCallback _callback;
+    };
+
+    /**
+     * @class StreamRegistry
+     * @brief 进行中的双向流表，按流id把收到的帧交给对应的一端
+     * @details 只持有弱引用，流的生命周期由使用方决定，结束回调中从表中移除
+     */
+    class StreamRegistry
+    {
+    public:
+        using ptr = std::shared_ptr<StreamRegistry>;
+
+        void add(const BaseConnection::ptr &conn, const StreamChannel::ptr &channel)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _channels[channel->id()] = Entry{conn.get(), channel};
+        }
+
+        void remove(const std::string &id)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _channels.erase(id);
+        }
+
+        /**
+         * @brief 把帧交给对应的流，流不存在或不属于该连接时丢弃
+         */
+        void onFrame(const BaseConnection::ptr &conn, std::shared_ptr<StreamFrame> &frame)
+        {
+            StreamChannel::ptr channel;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                auto it = _channels.find(frame->rid());
+                if (it == _channels.end() || it->second.owner != conn.get())
+                {
+                    SUP_LOG_DEBUG("收到流帧 - {}，但是未找到对应的流", frame->rid());
+                    return;
+                }
+                channel = it->second.channel.lock();
+            }
+            if (channel)
+                channel->onFrame(frame);
+        }
+
+        size_t size()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            return _channels.size();
+        }
+
+    private:
+        struct Entry
+        {
+            const BaseConnection *owner;
+            std::weak_ptr<StreamChannel> channel;
+        };
+        std::mutex _mutex;
+        std::unordered_map<std::string, Entry> _channels;
+    };
+}
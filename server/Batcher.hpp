@@ -0,0 +1,194 @@
+/**
+ * @file Batcher.hpp
+ * @brief 批处理方法的请求攒批
+ */
+
+#pragma once
+#include "../common/MuduoTool.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+namespace suprpc
+{
+    namespace server
+    {
+        /**
+         * @struct BatchPolicy
+         * @brief 方法级别的攒批窗口
+         */
+        struct BatchPolicy
+        {
+            size_t max_batch = 64;   // 攒够这么多个请求立即执行
+            int max_delay_us = 1000; // 第一个请求最多等待的时间
+        };
+
+        /**
+         * @class RequestBatcher
+         * @brief 把同一方法的并发请求攒成一批，交给批处理回调一次执行
+         * @details 批次在攒满max_batch时由提交最后一个请求的线程交出，否则在第一个请求等待max_delay_us后
+         *          由攒批线程交出。设置了执行器时批次交给执行器(方法所属的线程池)执行，否则在交出的线程中执行
+         */
+        class RequestBatcher
+        {
+        public:
+            using ptr = std::shared_ptr<RequestBatcher>;
+            using Clock = std::chrono::steady_clock;
+            // 以单个请求的结果完成该请求
+            using DoneCallback = std::function<void(const Json::Value &, RCode)>;
+            struct Item
+            {
+                Json::Value params;
+                DoneCallback done;
+            };
+            using FlushCallback = std::function<void(std::vector<Item> &)>;
+            // 执行一批请求：run执行该批，执行器拒绝或挤出该批时调用fail
+            using Executor = std::function<void(const std::function<void()> &run, const std::function<void()> &fail)>;
+
+            RequestBatcher(const BatchPolicy &policy, const FlushCallback &cb)
+                : _policy(policy), _flush(cb), _stop(false), _batches(0), _calls(0)
+            {
+                if (_policy.max_batch == 0)
+                    _policy.max_batch = 1;
+            }
+
+            ~RequestBatcher()
+            {
+                shutdown();
+            }
+
+            // 在开始接收请求之前设置
+            void setExecutor(const Executor &executor)
+            {
+                _executor = executor;
+            }
+
+            /**
+             * @brief 停止攒批，尚未执行的请求以RCODE_INTERNAL_ERROR结束，之后到达的请求同样直接结束
+             * @details 请求的完成回调引用路由，路由析构时须先调用本函数
+             */
+            void shutdown()
+            {
+                std::vector<Item> pending;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _stop = true;
+                    pending.swap(_pending);
+                }
+                _cond.notify_all();
+                if (_thread.joinable() && _thread.get_id() != std::this_thread::get_id())
+                {
+                    _thread.join();
+                }
+                fail(pending, RCode::RCODE_INTERNAL_ERROR);
+            }
+
+            void add(const Json::Value &params, const DoneCallback &done)
+            {
+                std::vector<Item> ready;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    if (_stop)
+                    {
+                        lock.unlock();
+                        return done(Json::Value(), RCode::RCODE_INTERNAL_ERROR);
+                    }
+                    if (_pending.empty())
+                    {
+                        _deadline = Clock::now() + std::chrono::microseconds(_policy.max_delay_us);
+                        if (_thread.joinable() == false)
+                        {
+                            _thread = std::thread(&RequestBatcher::timerLoop, this);
+                        }
+                        _cond.notify_one();
+                    }
+                    _pending.push_back(Item{params, done});
+                    if (_pending.size() >= _policy.max_batch)
+                    {
+                        ready.swap(_pending);
+                    }
+                }
+                if (ready.empty() == false)
+                {
+                    run(ready);
+                }
+            }
+
+            Json::Value stats()
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                Json::Value val;
+                val["batches"] = (Json::UInt64)_batches;
+                val["calls"] = (Json::UInt64)_calls;
+                val["pending"] = (Json::UInt64)_pending.size();
+                return val;
+            }
+
+        private:
+            void run(std::vector<Item> &items)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    ++_batches;
+                    _calls += items.size();
+                }
+                if (!_executor)
+                {
+                    return _flush(items);
+                }
+                auto batch = std::make_shared<std::vector<Item>>(std::move(items));
+                FlushCallback flush = _flush;
+                _executor([flush, batch]()
+                          { flush(*batch); },
+                          [batch]()
+                          { fail(*batch, RCode::RCODE_OVERLOADED); });
+            }
+
+            static void fail(std::vector<Item> &items, RCode code)
+            {
+                for (auto &item : items)
+                {
+                    item.done(Json::Value(), code);
+                }
+            }
+
+            // 攒批线程：等到当前批次的截止时间，仍未攒满则直接执行
+            void timerLoop()
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                while (_stop == false)
+                {
+                    if (_pending.empty())
+                    {
+                        _cond.wait(lock);
+                        continue;
+                    }
+                    if (Clock::now() < _deadline)
+                    {
+                        _cond.wait_until(lock, _deadline);
+                        continue;
+                    }
+                    std::vector<Item> ready;
+                    ready.swap(_pending);
+                    lock.unlock();
+                    run(ready);
+                    lock.lock();
+                }
+            }
+
+        private:
+            BatchPolicy _policy;
+            FlushCallback _flush;
+            Executor _executor;
+            std::mutex _mutex;
+            std::condition_variable _cond;
+            std::vector<Item> _pending;
+            Clock::time_point _deadline; // 当前批次的执行时间
+            bool _stop;
+            size_t _batches;
+            size_t _calls;
+            std::thread _thread;
+        };
+    }
+}
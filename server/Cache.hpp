@@ -0,0 +1,133 @@
+/**
+ * @file Cache.hpp
+ * @brief 纯函数方法的响应缓存
+ */
+
+#pragma once
+#include "../common/MuduoTool.hpp"
+#include <chrono>
+#include <list>
+#include <unordered_map>
+
+namespace suprpc
+{
+    namespace server
+    {
+        /**
+         * @struct CachePolicy
+         * @brief 方法级别的缓存策略
+         */
+        struct CachePolicy
+        {
+            int ttl_ms = 0;           // 缓存有效期，0表示不缓存
+            size_t max_entries = 0;   // 最多缓存的结果数，0表示不限制
+            size_t max_bytes = 0;     // 缓存占用的字节上限，0表示不限制
+        };
+
+        /**
+         * @class ResponseCache
+         * @brief 按参数哈希索引的LRU响应缓存
+         * @details 缓存的是已序列化的响应正文，命中时既跳过业务回调也跳过序列化。
+         *          条目同时保存规范化参数，哈希冲突时按未命中处理
+         */
+        class ResponseCache
+        {
+        public:
+            using ptr = std::shared_ptr<ResponseCache>;
+            using Clock = std::chrono::steady_clock;
+            ResponseCache(const CachePolicy &policy)
+                : _policy(policy), _bytes(0), _hits(0), _misses(0), _evictions(0) {}
+
+            /**
+             * @param params 规范化后的参数
+             * @param body 命中时写入已序列化的响应正文
+             */
+            bool get(const std::string &params, std::string &body)
+            {
+                size_t hash = std::hash<std::string>{}(params);
+                std::unique_lock<std::mutex> lock(_mutex);
+                auto it = _index.find(hash);
+                if (it == _index.end() || it->second->params != params)
+                {
+                    ++_misses;
+                    return false;
+                }
+                if (Clock::now() > it->second->expire)
+                {
+                    erase(it->second);
+                    ++_misses;
+                    return false;
+                }
+                _lru.splice(_lru.begin(), _lru, it->second);
+                body = it->second->body;
+                ++_hits;
+                return true;
+            }
+
+            void put(const std::string &params, const std::string &body)
+            {
+                size_t bytes = params.size() + body.size();
+                if (_policy.max_bytes > 0 && bytes > _policy.max_bytes)
+                {
+                    return;
+                }
+                size_t hash = std::hash<std::string>{}(params);
+                std::unique_lock<std::mutex> lock(_mutex);
+                auto it = _index.find(hash);
+                if (it != _index.end())
+                {
+                    erase(it->second);
+                }
+                _lru.push_front(Entry{hash, params, body,
+                                      Clock::now() + std::chrono::milliseconds(_policy.ttl_ms)});
+                _index[hash] = _lru.begin();
+                _bytes += bytes;
+                while ((_policy.max_entries > 0 && _lru.size() > _policy.max_entries) ||
+                       (_policy.max_bytes > 0 && _bytes > _policy.max_bytes))
+                {
+                    erase(std::prev(_lru.end()));
+                    ++_evictions;
+                }
+            }
+
+            Json::Value stats()
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                Json::Value val;
+                val["hits"] = (Json::UInt64)_hits;
+                val["misses"] = (Json::UInt64)_misses;
+                val["evictions"] = (Json::UInt64)_evictions;
+                val["entries"] = (Json::UInt64)_lru.size();
+                val["bytes"] = (Json::UInt64)_bytes;
+                return val;
+            }
+
+        private:
+            struct Entry
+            {
+                size_t hash;
+                std::string params;
+                std::string body;
+                Clock::time_point expire;
+            };
+
+            // 持锁调用
+            void erase(std::list<Entry>::iterator entry)
+            {
+                _bytes -= entry->params.size() + entry->body.size();
+                _index.erase(entry->hash);
+                _lru.erase(entry);
+            }
+
+        private:
+            const CachePolicy _policy;
+            std::mutex _mutex;
+            std::list<Entry> _lru; // 表头为最近使用
+            std::unordered_map<size_t, std::list<Entry>::iterator> _index;
+            size_t _bytes;
+            size_t _hits;
+            size_t _misses;
+            size_t _evictions;
+        };
+    }
+}
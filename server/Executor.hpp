@@ -0,0 +1,589 @@
+/**
+ * @file Executor.hpp
+ * @brief 请求排队与工作线程池的实现
+ */
+
+#pragma once
+#include "../common/MuduoTool.hpp"
+#include "../common/Affinity.hpp"
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace suprpc
+{
+    namespace server
+    {
+        /**
+         * @class QueuePolicy
+         * @brief 请求队列的出队顺序
+         */
+        enum class QueuePolicy
+        {
+            FIFO = 0, // 先进先出
+            EDF,      // 截止时间最早者优先
+            FAIR      // 按租户或连接加权公平调度
+        };
+
+        // 公平调度中各租户的权重，未配置的租户与连接权重为1
+        using FairWeights = std::unordered_map<std::string, size_t>;
+
+        /**
+         * @struct RequestTask
+         * @brief 排队等待执行的一次请求
+         */
+        struct RequestTask
+        {
+            using Clock = std::chrono::steady_clock;
+            Clock::time_point deadline = Clock::time_point::max(); // 不限时为最大时间点
+            int64_t cost_us = 0;                                   // 预计执行耗时
+            uint64_t seq = 0;                                      // 入队序号，由队列填写
+            Priority priority = Priority::NORMAL;                  // 高优先级请求走独立通道
+            std::string flow;                                      // 公平调度的分组：租户标签或连接
+            std::string tenant;                                    // 分组对应的租户，用于查找权重
+            std::function<void()> run;                             // 执行请求
+            std::function<void()> drop;                            // 请求在执行前被丢弃
+            std::function<void()> reject;                          // 请求入队后被挤出，应以过载拒绝
+
+            // 即使立刻开始执行也无法在截止时间前完成
+            bool hopeless(Clock::time_point now) const
+            {
+                if (deadline == Clock::time_point::max())
+                {
+                    return false;
+                }
+                return now + std::chrono::microseconds(cost_us) > deadline;
+            }
+        };
+
+        /**
+         * @class RequestQueue
+         * @brief 有界的阻塞请求队列基类，子类只需决定出队顺序
+         * @details 出队时顺带剔除已无法按时完成的请求，这些请求在锁外调用drop。
+         *          高优先级请求进入独立的先进先出通道，单独计算容量，优先于普通请求出队；
+         *          优先级由调用方自行声明，为免加急通道饿死其他租户，连续出队urgent_burst个高优先级请求后
+         *          若仍有普通请求等待，就让出一次给普通请求，普通请求之间的顺序仍由子类决定
+         */
+        class RequestQueue
+        {
+        public:
+            using ptr = std::shared_ptr<RequestQueue>;
+            static constexpr size_t urgent_burst = 4; // 普通请求等待时，加急通道最多连续出队的个数
+            RequestQueue(size_t capacity) : _capacity(capacity), _closed(false), _seq(0), _urgent_streak(0),
+                                            _dropped(0), _evicted(0) {}
+            virtual ~RequestQueue() {}
+
+            /**
+             * @details 普通请求到来时队列已满，子类可以挤出另一个已排队的请求给它让位，被挤出的请求在锁外调用reject
+             * @return 队列已满或已关闭返回false
+             */
+            bool push(RequestTask &&task)
+            {
+                RequestTask victim;
+                bool evicted = false;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    if (_closed)
+                    {
+                        return false;
+                    }
+                    task.seq = _seq++;
+                    size_t queued = (task.priority == Priority::HIGH) ? _urgent.size() : size();
+                    if (_capacity > 0 && queued >= _capacity)
+                    {
+                        if (task.priority == Priority::HIGH || evict(task, victim) == false)
+                        {
+                            return false;
+                        }
+                        evicted = true;
+                    }
+                    if (task.priority == Priority::HIGH)
+                    {
+                        _urgent.push_back(std::move(task));
+                    }
+                    else
+                    {
+                        enqueue(std::move(task));
+                    }
+                }
+                _cond.notify_one();
+                if (evicted)
+                {
+                    _evicted.fetch_add(1, std::memory_order_relaxed);
+                    if (victim.reject)
+                        victim.reject();
+                }
+                return true;
+            }
+
+            /**
+             * @brief 阻塞取出下一个请求
+             * @return 队列关闭且为空时返回false
+             */
+            bool pop(RequestTask &task)
+            {
+                while (true)
+                {
+                    std::vector<RequestTask> dropped;
+                    bool ret = false;
+                    {
+                        std::unique_lock<std::mutex> lock(_mutex);
+                        _cond.wait(lock, [this]()
+                                   { return _closed || size() > 0 || _urgent.empty() == false; });
+                        if (size() == 0 && _urgent.empty())
+                        {
+                            return false;
+                        }
+                        auto now = RequestTask::Clock::now();
+                        ret = next(task, now, dropped);
+                    }
+                    _dropped.fetch_add(dropped.size(), std::memory_order_relaxed);
+                    for (auto &t : dropped)
+                    {
+                        if (t.drop)
+                            t.drop();
+                    }
+                    if (ret)
+                    {
+                        return true;
+                    }
+                }
+            }
+
+            void close()
+            {
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _closed = true;
+                }
+                _cond.notify_all();
+            }
+
+            size_t length()
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                return size() + _urgent.size();
+            }
+
+            size_t dropped() { return _dropped.load(); }
+
+            size_t evicted() { return _evicted.load(); }
+
+        protected:
+            // 以下接口均在持锁状态下调用
+            virtual void enqueue(RequestTask &&task) = 0;
+            // 取出一个可执行的请求，过程中淘汰的请求放入dropped；没有可执行请求时返回false
+            virtual bool dequeue(RequestTask &task, RequestTask::Clock::time_point now,
+                                 std::vector<RequestTask> &dropped) = 0;
+            virtual size_t size() = 0;
+            // 队列已满时为incoming挤出一个已排队的请求放入victim，不挤出时返回false
+            virtual bool evict(const RequestTask &, RequestTask &) { return false; }
+
+        private:
+            // 按加急通道的份额决定先看哪条通道，一条通道没有可执行的请求时再看另一条
+            bool next(RequestTask &task, RequestTask::Clock::time_point now,
+                      std::vector<RequestTask> &dropped)
+            {
+                if (_urgent_streak >= urgent_burst && size() > 0)
+                {
+                    _urgent_streak = 0;
+                    if (dequeue(task, now, dropped))
+                    {
+                        return true;
+                    }
+                }
+                if (dequeueUrgent(task, now, dropped))
+                {
+                    ++_urgent_streak;
+                    return true;
+                }
+                _urgent_streak = 0;
+                return dequeue(task, now, dropped);
+            }
+
+            bool dequeueUrgent(RequestTask &task, RequestTask::Clock::time_point now,
+                               std::vector<RequestTask> &dropped)
+            {
+                while (_urgent.empty() == false)
+                {
+                    RequestTask front = std::move(_urgent.front());
+                    _urgent.pop_front();
+                    if (now > front.deadline)
+                    {
+                        dropped.push_back(std::move(front));
+                        continue;
+                    }
+                    task = std::move(front);
+                    return true;
+                }
+                return false;
+            }
+
+        private:
+            std::mutex _mutex;
+            std::condition_variable _cond;
+            size_t _capacity;
+            bool _closed;
+            uint64_t _seq;
+            size_t _urgent_streak; // 加急通道连续出队的个数
+            std::atomic<size_t> _dropped;
+            std::atomic<size_t> _evicted;
+            std::deque<RequestTask> _urgent;
+        };
+
+        /**
+         * @class FifoQueue
+         * @brief 先进先出队列，出队时丢弃已过截止时间的请求
+         */
+        class FifoQueue : public RequestQueue
+        {
+        public:
+            FifoQueue(size_t capacity) : RequestQueue(capacity) {}
+
+        protected:
+            virtual void enqueue(RequestTask &&task) override
+            {
+                _tasks.push_back(std::move(task));
+            }
+
+            virtual bool dequeue(RequestTask &task, RequestTask::Clock::time_point now,
+                                 std::vector<RequestTask> &dropped) override
+            {
+                while (_tasks.empty() == false)
+                {
+                    RequestTask front = std::move(_tasks.front());
+                    _tasks.pop_front();
+                    if (now > front.deadline)
+                    {
+                        dropped.push_back(std::move(front));
+                        continue;
+                    }
+                    task = std::move(front);
+                    return true;
+                }
+                return false;
+            }
+
+            virtual size_t size() override { return _tasks.size(); }
+
+        private:
+            std::deque<RequestTask> _tasks;
+        };
+
+        /**
+         * @class EdfQueue
+         * @brief 最早截止时间优先队列
+         * @details 按剩余预算排序，出队时淘汰预计耗时已超出剩余预算的请求。
+         *          不限时的请求以入队时刻加上implicit_budget作为排序用的截止时间，
+         *          等待越久越靠前，不会被源源不断的限时请求饿死；它们本身不会因超时被淘汰
+         */
+        class EdfQueue : public RequestQueue
+        {
+        public:
+            static constexpr int64_t default_implicit_budget_ms = 1000;
+            EdfQueue(size_t capacity, int64_t implicit_budget_ms = default_implicit_budget_ms)
+                : RequestQueue(capacity), _implicit_budget(std::chrono::milliseconds(implicit_budget_ms)) {}
+
+        protected:
+            virtual void enqueue(RequestTask &&task) override
+            {
+                RequestTask::Clock::time_point key = task.deadline;
+                if (key == RequestTask::Clock::time_point::max())
+                {
+                    key = RequestTask::Clock::now() + _implicit_budget;
+                }
+                _heap.push_back(Entry{key, std::move(task)});
+                std::push_heap(_heap.begin(), _heap.end(), later);
+            }
+
+            virtual bool dequeue(RequestTask &task, RequestTask::Clock::time_point now,
+                                 std::vector<RequestTask> &dropped) override
+            {
+                while (_heap.empty() == false)
+                {
+                    std::pop_heap(_heap.begin(), _heap.end(), later);
+                    RequestTask top = std::move(_heap.back().task);
+                    _heap.pop_back();
+                    if (top.hopeless(now))
+                    {
+                        dropped.push_back(std::move(top));
+                        continue;
+                    }
+                    task = std::move(top);
+                    return true;
+                }
+                return false;
+            }
+
+            virtual size_t size() override { return _heap.size(); }
+
+        private:
+            struct Entry
+            {
+                RequestTask::Clock::time_point key; // 排序用的截止时间
+                RequestTask task;
+            };
+
+            // 堆比较器：a比b更晚执行
+            static bool later(const Entry &a, const Entry &b)
+            {
+                if (a.key != b.key)
+                {
+                    return a.key > b.key;
+                }
+                return a.task.seq > b.task.seq;
+            }
+
+        private:
+            RequestTask::Clock::duration _implicit_budget;
+            std::vector<Entry> _heap;
+        };
+
+        /**
+         * @class FairQueue
+         * @brief 按分组加权的差额轮询(DRR)队列
+         * @details 每个分组(租户或连接)各自先进先出，分组之间轮流出队。分组每轮获得
+         *          权重×fair_quantum_us的额度，出队一个请求消耗其预计执行耗时，额度不足时让给下一分组。
+         *          大量流水线请求只会排长自己分组的队列，其他分组的排队时延只取决于分组数与各自权重。
+         *          容量对所有分组共享，队列满时从按权重折算后积压最多的分组挤出最后一个请求，
+         *          该分组自己的请求才被直接拒绝；出队时丢弃已过截止时间的请求
+         */
+        class FairQueue : public RequestQueue
+        {
+        public:
+            FairQueue(size_t capacity, const FairWeights &weights)
+                : RequestQueue(capacity), _weights(weights), _size(0) {}
+
+        protected:
+            virtual void enqueue(RequestTask &&task) override
+            {
+                Flow &flow = _flows[task.flow];
+                if (flow.tasks.empty())
+                {
+                    flow.deficit = 0;
+                    flow.weight = weightOf(task.tenant);
+                    _active.push_back(task.flow);
+                }
+                flow.tasks.push_back(std::move(task));
+                ++_size;
+            }
+
+            virtual bool dequeue(RequestTask &task, RequestTask::Clock::time_point now,
+                                 std::vector<RequestTask> &dropped) override
+            {
+                while (_active.empty() == false)
+                {
+                    auto it = _flows.find(_active.front());
+                    Flow &flow = it->second;
+                    while (flow.tasks.empty() == false && now > flow.tasks.front().deadline)
+                    {
+                        dropped.push_back(std::move(flow.tasks.front()));
+                        flow.tasks.pop_front();
+                        --_size;
+                    }
+                    if (flow.tasks.empty())
+                    {
+                        _active.pop_front();
+                        _flows.erase(it);
+                        continue;
+                    }
+                    int64_t cost = std::min<int64_t>(std::max<int64_t>(flow.tasks.front().cost_us, 1),
+                                                     fair_quantum_us * max_quantum_per_task);
+                    if (flow.deficit < cost)
+                    {
+                        // 额度不足，补充本轮额度后轮到下一分组
+                        flow.deficit += fair_quantum_us * (int64_t)flow.weight;
+                        _active.push_back(_active.front());
+                        _active.pop_front();
+                        continue;
+                    }
+                    flow.deficit -= cost;
+                    task = std::move(flow.tasks.front());
+                    flow.tasks.pop_front();
+                    --_size;
+                    if (flow.tasks.empty())
+                    {
+                        _active.pop_front();
+                        _flows.erase(it);
+                    }
+                    return true;
+                }
+                return false;
+            }
+
+            virtual size_t size() override { return _size; }
+
+            virtual bool evict(const RequestTask &incoming, RequestTask &victim) override
+            {
+                size_t own = 0;
+                auto self = _flows.find(incoming.flow);
+                if (self != _flows.end())
+                {
+                    own = self->second.tasks.size();
+                }
+                size_t own_weight = weightOf(incoming.tenant);
+                // 积压按权重折算后比较：a/wa > b/wb 即 a*wb > b*wa
+                auto largest = _flows.end();
+                for (auto it = _flows.begin(); it != _flows.end(); ++it)
+                {
+                    if (largest == _flows.end() ||
+                        it->second.tasks.size() * largest->second.weight > largest->second.tasks.size() * it->second.weight)
+                    {
+                        largest = it;
+                    }
+                }
+                // 入队后自己的积压仍不低于最大者时，拒绝的应当是自己
+                if (largest == _flows.end() || largest == self ||
+                    largest->second.tasks.size() * own_weight <= (own + 1) * largest->second.weight)
+                {
+                    return false;
+                }
+                victim = std::move(largest->second.tasks.back());
+                largest->second.tasks.pop_back();
+                --_size;
+                if (largest->second.tasks.empty())
+                {
+                    _active.erase(std::find(_active.begin(), _active.end(), largest->first));
+                    _flows.erase(largest);
+                }
+                return true;
+            }
+
+        private:
+            struct Flow
+            {
+                std::deque<RequestTask> tasks;
+                int64_t deficit = 0;
+                size_t weight = 1;
+            };
+
+            size_t weightOf(const std::string &tenant)
+            {
+                auto it = _weights.find(tenant);
+                if (it == _weights.end() || it->second == 0)
+                {
+                    return 1;
+                }
+                return it->second;
+            }
+
+        private:
+            static const int64_t fair_quantum_us = 1000;
+            static const int64_t max_quantum_per_task = 16; // 单个请求最多消耗的轮数，避免长耗时请求让轮询空转
+            const FairWeights _weights;
+            std::unordered_map<std::string, Flow> _flows; // 只保存有请求排队的分组
+            std::deque<std::string> _active;              // 轮询顺序
+            size_t _size;
+        };
+
+        /**
+         * @class QueueFactory
+         * @brief 按策略生成请求队列的工厂
+         */
+        class QueueFactory
+        {
+        public:
+            static RequestQueue::ptr create(QueuePolicy policy, size_t capacity,
+                                            const FairWeights &weights = FairWeights())
+            {
+                switch (policy)
+                {
+                case QueuePolicy::EDF:
+                    return std::make_shared<EdfQueue>(capacity);
+                case QueuePolicy::FAIR:
+                    return std::make_shared<FairQueue>(capacity, weights);
+                case QueuePolicy::FIFO:
+                default:
+                    return std::make_shared<FifoQueue>(capacity);
+                }
+            }
+        };
+
+        /**
+         * @class WorkerPool
+         * @brief 从请求队列取任务执行的工作线程池
+         */
+        class WorkerPool
+        {
+        public:
+            using ptr = std::shared_ptr<WorkerPool>;
+            /**
+             * @param cpus 工作线程依次绑定的CPU，为空表示不绑定
+             */
+            WorkerPool(size_t thread_num, const RequestQueue::ptr &queue,
+                       const std::vector<int> &cpus = std::vector<int>())
+                : _queue(queue), _executed(0), _rejected(0)
+            {
+                for (size_t i = 0; i < std::max<size_t>(thread_num, 1); ++i)
+                {
+                    _threads.emplace_back(&WorkerPool::workLoop, this, Affinity::pick(cpus, i));
+                }
+            }
+
+            ~WorkerPool()
+            {
+                stop();
+            }
+
+            /**
+             * @brief 提交一个请求
+             * @return 队列已满或已停止返回false，由调用方负责拒绝该请求
+             */
+            bool submit(RequestTask &&task)
+            {
+                if (_queue->push(std::move(task)) == false)
+                {
+                    _rejected.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                return true;
+            }
+
+            void stop()
+            {
+                _queue->close();
+                for (auto &thread : _threads)
+                {
+                    if (thread.joinable())
+                        thread.join();
+                }
+            }
+
+            Json::Value stats()
+            {
+                Json::Value val;
+                val["threads"] = (Json::UInt64)_threads.size();
+                val["queued"] = (Json::UInt64)_queue->length();
+                val["executed"] = (Json::UInt64)_executed.load();
+                val["dropped"] = (Json::UInt64)_queue->dropped();
+                val["rejected"] = (Json::UInt64)_rejected.load();
+                val["evicted"] = (Json::UInt64)_queue->evicted();
+                return val;
+            }
+
+        private:
+            void workLoop(int cpu)
+            {
+                Affinity::pinCurrentThread(cpu);
+                RequestTask task;
+                while (_queue->pop(task))
+                {
+                    task.run();
+                    _executed.fetch_add(1, std::memory_order_relaxed);
+                    task = RequestTask();
+                }
+            }
+
+        private:
+            RequestQueue::ptr _queue;
+            std::atomic<size_t> _executed;
+            std::atomic<size_t> _rejected;
+            std::vector<std::thread> _threads;
+        };
+    }
+}
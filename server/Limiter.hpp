@@ -0,0 +1,137 @@
+/**
+ * @file Limiter.hpp
+ * @brief 自适应并发限制器
+ */
+
+#pragma once
+#include "../common/MuduoTool.hpp"
+#include <atomic>
+#include <algorithm>
+
+namespace suprpc
+{
+    namespace server
+    {
+        /**
+         * @class ConcurrencyLimiter
+         * @brief 基于处理时延的AIMD并发限制器
+         * @details 记录无负载时延(窗口内最小时延)，样本时延超过其tolerance倍或处理失败时，
+         *          限制乘性减小；正常且并发已接近限制时加性增大。超过限制的请求直接拒绝
+         */
+        class ConcurrencyLimiter
+        {
+        public:
+            using ptr = std::shared_ptr<ConcurrencyLimiter>;
+            ConcurrencyLimiter(size_t initial_limit, size_t max_limit,
+                               size_t min_limit = 1, double tolerance = 2.0)
+                : _min_limit(std::max<size_t>(min_limit, 1)),
+                  _max_limit(std::max(max_limit, _min_limit)),
+                  _limit(std::min(std::max(initial_limit, _min_limit), _max_limit)),
+                  _tolerance(tolerance),
+                  _inflight(0),
+                  _rejected(0),
+                  _rtt_noload(0),
+                  _rtt_window_min(0),
+                  _samples(0)
+            {
+            }
+
+            /**
+             * @brief 尝试占用一个并发名额
+             * @return 已达到限制返回false
+             */
+            bool tryAcquire()
+            {
+                size_t inflight = _inflight.fetch_add(1) + 1;
+                if (inflight > (size_t)_limit.load(std::memory_order_relaxed))
+                {
+                    _inflight.fetch_sub(1);
+                    _rejected.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                return true;
+            }
+
+            /**
+             * @brief 归还名额并以本次处理时延调整限制
+             * @param latency_us 处理时延，单位微秒
+             * @param ok 处理是否成功，失败视为过载信号
+             */
+            void release(int64_t latency_us, bool ok)
+            {
+                size_t inflight = _inflight.fetch_sub(1);
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (latency_us > 0)
+                {
+                    updateRtt(latency_us);
+                }
+                double limit = _limit.load(std::memory_order_relaxed);
+                if (ok == false || (_rtt_noload > 0 && latency_us > _tolerance * _rtt_noload))
+                {
+                    limit = limit * 0.9;
+                }
+                else if (inflight * 2 >= limit)
+                {
+                    limit = limit + 1;
+                }
+                limit = std::min(std::max(limit, (double)_min_limit), (double)_max_limit);
+                _limit.store(limit, std::memory_order_relaxed);
+            }
+
+            /**
+             * @brief 归还名额但不作为时延样本，用于请求在执行前被拒绝或丢弃
+             */
+            void cancel()
+            {
+                _inflight.fetch_sub(1);
+            }
+
+            size_t inflight() { return _inflight.load(); }
+            size_t limit() { return (size_t)_limit.load(std::memory_order_relaxed); }
+
+            Json::Value stats()
+            {
+                Json::Value val;
+                val["limit"] = (Json::UInt64)limit();
+                val["inflight"] = (Json::UInt64)inflight();
+                val["rejected"] = (Json::UInt64)_rejected.load();
+                std::unique_lock<std::mutex> lock(_mutex);
+                val["rtt_noload_us"] = (Json::Int64)_rtt_noload;
+                return val;
+            }
+
+        private:
+            // 无负载时延取窗口内最小值，窗口滚动以便适应业务时延的长期变化
+            void updateRtt(int64_t latency_us)
+            {
+                if (_rtt_window_min == 0 || latency_us < _rtt_window_min)
+                {
+                    _rtt_window_min = latency_us;
+                }
+                if (_rtt_noload == 0 || latency_us < _rtt_noload)
+                {
+                    _rtt_noload = latency_us;
+                }
+                if (++_samples >= rtt_window)
+                {
+                    _rtt_noload = _rtt_window_min;
+                    _rtt_window_min = 0;
+                    _samples = 0;
+                }
+            }
+
+        private:
+            static const size_t rtt_window = 1000;
+            const size_t _min_limit;
+            const size_t _max_limit;
+            std::atomic<double> _limit;
+            const double _tolerance;
+            std::atomic<size_t> _inflight;
+            std::atomic<size_t> _rejected;
+            std::mutex _mutex; // 保护以下时延统计
+            int64_t _rtt_noload;
+            int64_t _rtt_window_min;
+            size_t _samples;
+        };
+    }
+}
@@ -7,6 +7,14 @@
 
 #include "../common/MuduoTool.hpp"
 #include "../common/Message.hpp"
+#include "../common/Stream.hpp"
+#include "Limiter.hpp"
+#include "Executor.hpp"
+#include "Cache.hpp"
+#include "Batcher.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
 
 namespace suprpc
 {
@@ -22,11 +30,337 @@ namespace suprpc
             OBJECT,
         };
 
+        /**
+         * @class CancelToken
+         * @brief 请求的取消标记，客户端发来取消帧时置位
+         * @details 批量中的调用以整个批量的标记为上级，批量被取消时其中的调用一并视为取消
+         */
+        class CancelToken
+        {
+        public:
+            using ptr = std::shared_ptr<CancelToken>;
+            CancelToken(const BaseConnection *owner, const ptr &parent = ptr())
+                : _owner(owner), _parent(parent), _cancelled(false) {}
+            bool cancelled()
+            {
+                return _cancelled.load(std::memory_order_acquire) || (_parent && _parent->cancelled());
+            }
+            void cancel() { _cancelled.store(true, std::memory_order_release); }
+            const BaseConnection *owner() { return _owner; }
+
+        private:
+            const BaseConnection *_owner; // 只允许发起请求的连接取消
+            ptr _parent;
+            std::atomic<bool> _cancelled;
+        };
+
+        /**
+         * @class CancelRegistry
+         * @brief 可被取消的进行中请求表，按请求id分段加锁
+         */
+        class CancelRegistry
+        {
+        public:
+            CancelToken::ptr add(const BaseConnection::ptr &conn, const std::string &rid,
+                                 const CancelToken::ptr &parent = CancelToken::ptr())
+            {
+                auto token = std::make_shared<CancelToken>(conn.get(), parent);
+                Segment &seg = segment(rid);
+                std::unique_lock<std::mutex> lock(seg.mutex);
+                seg.tokens[rid] = token;
+                return token;
+            }
+
+            void remove(const std::string &rid)
+            {
+                Segment &seg = segment(rid);
+                std::unique_lock<std::mutex> lock(seg.mutex);
+                seg.tokens.erase(rid);
+            }
+
+            /**
+             * @return 找不到对应请求或连接不匹配时返回false
+             */
+            bool cancel(const BaseConnection::ptr &conn, const std::string &rid)
+            {
+                Segment &seg = segment(rid);
+                std::unique_lock<std::mutex> lock(seg.mutex);
+                auto it = seg.tokens.find(rid);
+                if (it == seg.tokens.end() || it->second->owner() != conn.get())
+                {
+                    return false;
+                }
+                it->second->cancel();
+                return true;
+            }
+
+        private:
+            struct Segment
+            {
+                std::mutex mutex;
+                std::unordered_map<std::string, CancelToken::ptr> tokens;
+            };
+
+            Segment &segment(const std::string &rid)
+            {
+                return _segments[std::hash<std::string>{}(rid) % segment_num];
+            }
+
+        private:
+            static const size_t segment_num = 16;
+            Segment _segments[segment_num];
+        };
+
+        /**
+         * @class CallCollapser
+         * @brief 合并相同的并发调用
+         * @details 以方法名与规范化参数为键记录正在执行的调用。同键的后续请求只登记为跟随者，
+         *          首个请求执行完成时取出全部跟随者，以相同的结果分别应答。
+         *          Json对象的成员按键名有序存储，序列化结果即可作为参数的规范形式
+         */
+        class CallCollapser
+        {
+        public:
+            struct Follower
+            {
+                BaseConnection::ptr conn;
+                RpcRequest::ptr request;
+            };
+
+            static std::string keyOf(const RpcRequest::ptr &request)
+            {
+                std::string params;
+                JSON::serialize(request->params(), params);
+                return request->method() + '\n' + params;
+            }
+
+            /**
+             * @return 已有相同调用在执行时登记为跟随者并返回true；否则成为执行者并返回false
+             */
+            bool join(const std::string &key, const BaseConnection::ptr &conn, const RpcRequest::ptr &request)
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                auto it = _inflight.find(key);
+                if (it == _inflight.end())
+                {
+                    _inflight.emplace(key, std::vector<Follower>());
+                    return false;
+                }
+                it->second.push_back(Follower{conn, request});
+                return true;
+            }
+
+            /**
+             * @brief 执行者结束，取出并移除等待同一结果的跟随者
+             */
+            std::vector<Follower> take(const std::string &key)
+            {
+                std::vector<Follower> followers;
+                std::unique_lock<std::mutex> lock(_mutex);
+                auto it = _inflight.find(key);
+                if (it != _inflight.end())
+                {
+                    followers.swap(it->second);
+                    _inflight.erase(it);
+                }
+                return followers;
+            }
+
+            /**
+             * @brief 执行者未执行就结束，交还取出的跟随者
+             * @details 此时已有同键调用在执行则全部转为它的跟随者并返回false；
+             *          否则首个跟随者成为新的执行者放入leader并返回true，其余跟随者改为等待它
+             */
+            bool promote(const std::string &key, std::vector<Follower> &&followers, Follower &leader)
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                auto it = _inflight.find(key);
+                if (it != _inflight.end())
+                {
+                    for (auto &follower : followers)
+                        it->second.push_back(std::move(follower));
+                    return false;
+                }
+                leader = std::move(followers.front());
+                followers.erase(followers.begin());
+                _inflight.emplace(key, std::move(followers));
+                return true;
+            }
+
+        private:
+            std::mutex _mutex;
+            std::unordered_map<std::string, std::vector<Follower>> _inflight;
+        };
+
+        /**
+         * @class Responder
+         * @brief 异步业务回调的应答器
+         * @details 可以在任意线程、任意时刻完成，只有第一次完成生效；
+         *          若直到析构都未完成，则以内部错误应答，避免调用方一直等待
+         */
+        class Responder
+        {
+        public:
+            using ptr = std::shared_ptr<Responder>;
+            using CompleteCallback = std::function<void(const Json::Value &, RCode)>;
+            Responder(const CompleteCallback &cb, const CancelToken::ptr &token = CancelToken::ptr())
+                : _done(false), _callback(cb), _token(token) {}
+            ~Responder()
+            {
+                finish(Json::Value(), RCode::RCODE_INTERNAL_ERROR);
+            }
+
+            /**
+             * @brief 以处理结果完成本次调用
+             * @return 已经完成过则返回false
+             */
+            bool complete(const Json::Value &result)
+            {
+                return finish(result, RCode::RCODE_OK);
+            }
+
+            /**
+             * @brief 以错误码完成本次调用
+             * @return 已经完成过则返回false
+             */
+            bool fail(RCode code)
+            {
+                return finish(Json::Value(), code);
+            }
+
+            /**
+             * @brief 客户端是否已取消本次调用，扇出型业务可据此提前停止
+             */
+            bool cancelled()
+            {
+                return _token && _token->cancelled();
+            }
+
+        private:
+            bool finish(const Json::Value &result, RCode code)
+            {
+                if (_done.exchange(true) == true)
+                {
+                    return false;
+                }
+                _callback(result, code);
+                return true;
+            }
+
+        private:
+            std::atomic<bool> _done;
+            CompleteCallback _callback;
+            CancelToken::ptr _token;
+        };
+
+        /**
+         * @class StreamWriter
+         * @brief 流式业务回调的写出器
+         * @details 每次write发出一个数据帧，close或fail结束整个调用，由路由发出结束帧；
+         *          可以在任意线程使用，若直到析构都未结束，则以内部错误结束
+         */
+        class StreamWriter
+        {
+        public:
+            using ptr = std::shared_ptr<StreamWriter>;
+            using CloseCallback = std::function<void(RCode)>;
+            StreamWriter(const BaseConnection::ptr &conn, const RpcRequest::ptr &request,
+                         const CloseCallback &cb, const CancelToken::ptr &token = CancelToken::ptr())
+                : _conn(conn), _request(request), _done(false), _callback(cb), _token(token) {}
+            ~StreamWriter()
+            {
+                finish(RCode::RCODE_INTERNAL_ERROR);
+            }
+
+            /**
+             * @brief 发出一个数据帧
+             * @return 调用已结束、被取消、超过截止时间或连接已断开时返回false，业务应停止产生数据
+             */
+            bool write(const Json::Value &chunk)
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (_done || cancelled() || _conn->connected() == false || _request->expired())
+                {
+                    return false;
+                }
+                if (_request->oneway())
+                {
+                    return true;
+                }
+                auto msg = MessageFactory::create<RpcStreamResponse>();
+                msg->setId(_request->rid());
+                msg->setMType(MType::RSP_RPC_STREAM);
+                msg->setRCode(RCode::RCODE_OK);
+                msg->setResult(chunk);
+                msg->setPriority(_request->priority());
+                _conn->send(msg);
+                return true;
+            }
+
+            /**
+             * @brief 连接输出缓冲是否拥塞，生产者可据此暂停，避免数据堆积在服务端
+             */
+            bool congested()
+            {
+                return _conn->congested();
+            }
+
+            /**
+             * @brief 正常结束本次调用
+             * @return 已经结束过则返回false
+             */
+            bool close()
+            {
+                return finish(RCode::RCODE_OK);
+            }
+
+            /**
+             * @brief 以错误码结束本次调用
+             * @return 已经结束过则返回false
+             */
+            bool fail(RCode code)
+            {
+                return finish(code);
+            }
+
+            bool cancelled()
+            {
+                return _token && _token->cancelled();
+            }
+
+        private:
+            // 持锁结束，保证结束帧排在所有数据帧之后
+            bool finish(RCode code)
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (_done)
+                {
+                    return false;
+                }
+                _done = true;
+                _callback(code);
+                return true;
+            }
+
+        private:
+            BaseConnection::ptr _conn;
+            RpcRequest::ptr _request;
+            std::mutex _mutex;
+            bool _done;
+            CloseCallback _callback;
+            CancelToken::ptr _token;
+        };
+
         class ServiceDescribe
         {
         public:
             using ptr = std::shared_ptr<ServiceDescribe>;
             using ServiceCallback = std::function<void(const Json::Value &, Json::Value &)>;
+            using AsyncServiceCallback = std::function<void(const Json::Value &, const Responder::ptr &)>;
+            using StreamServiceCallback = std::function<void(const Json::Value &, const StreamWriter::ptr &)>;
+            using BidiServiceCallback = std::function<void(const Json::Value &, const StreamChannel::ptr &)>;
+            // 批处理回调：一次处理多个请求的参数，按相同顺序写出各自的结果
+            using BatchServiceCallback = std::function<void(const std::vector<Json::Value> &, std::vector<Json::Value> &)>;
             using ParamDescribe = std::pair<std::string, VType>;
             ServiceDescribe(std::string &&mthod_name,
                             std::vector<ParamDescribe> &&desc,
@@ -38,8 +372,59 @@ namespace suprpc
             {
             }
 
+            ServiceDescribe(std::string &&mthod_name,
+                            std::vector<ParamDescribe> &&desc,
+                            VType vtype,
+                            AsyncServiceCallback &&handler) : _method_name(mthod_name),
+                                                              _async_callback(std::move(handler)),
+                                                              _params_desc(std::move(desc)),
+                                                              _return_type(vtype)
+            {
+            }
+
+            ServiceDescribe(std::string &&mthod_name,
+                            std::vector<ParamDescribe> &&desc,
+                            VType vtype,
+                            StreamServiceCallback &&handler) : _method_name(mthod_name),
+                                                               _stream_callback(std::move(handler)),
+                                                               _params_desc(std::move(desc)),
+                                                               _return_type(vtype)
+            {
+            }
+
+            ServiceDescribe(std::string &&mthod_name,
+                            std::vector<ParamDescribe> &&desc,
+                            VType vtype,
+                            BidiServiceCallback &&handler) : _method_name(mthod_name),
+                                                             _bidi_callback(std::move(handler)),
+                                                             _params_desc(std::move(desc)),
+                                                             _return_type(vtype)
+            {
+            }
+
+            ServiceDescribe(std::string &&mthod_name,
+                            std::vector<ParamDescribe> &&desc,
+                            VType vtype,
+                            BatchServiceCallback &&handler,
+                            const BatchPolicy &policy) : _method_name(mthod_name),
+                                                         _batch_callback(std::move(handler)),
+                                                         _params_desc(std::move(desc)),
+                                                         _return_type(vtype)
+            {
+                _batcher = std::make_shared<RequestBatcher>(
+                    policy, std::bind(&ServiceDescribe::callBatch, this, std::placeholders::_1));
+            }
+
             const std::string &method() { return _method_name; }
 
+            bool isAsync() { return (bool)_async_callback; }
+
+            bool isStream() { return (bool)_stream_callback; }
+
+            bool isBidi() { return (bool)_bidi_callback; }
+
+            bool isBatch() { return (bool)_batch_callback; }
+
             bool paramCheck(const Json::Value &params)
             {
                 for (auto &desc : _params_desc)
@@ -69,12 +454,120 @@ namespace suprpc
                 return true;
             }
 
-        private:
+            /**
+             * @brief 异步调用，结果通过应答器返回
+             */
+            void callAsync(const Json::Value &params, const Responder::ptr &responder)
+            {
+                _async_callback(params, responder);
+            }
+
+            /**
+             * @brief 流式调用，结果分多帧通过写出器返回
+             */
+            void callStream(const Json::Value &params, const StreamWriter::ptr &writer)
+            {
+                _stream_callback(params, writer);
+            }
+
+            /**
+             * @brief 双向流调用，通过流的两端收发数据
+             */
+            void callBidi(const Json::Value &params, const StreamChannel::ptr &channel)
+            {
+                _bidi_callback(params, channel);
+            }
+
+            /**
+             * @brief 批处理调用，交给攒批器与其他并发请求一起执行，结果通过done返回
+             */
+            void callBatched(const Json::Value &params, const RequestBatcher::DoneCallback &done)
+            {
+                _batcher->add(params, done);
+            }
+
+            const RequestBatcher::ptr &batcher() { return _batcher; }
+
+            // 双向流中服务端的接收窗口(帧数)
+            int streamWindow() { return _stream_window; }
+            void setStreamWindow(int window) { _stream_window = window; }
+
             bool rtypeCheck(const Json::Value &val)
             {
                 return check(_return_type, val);
             }
 
+            const ConcurrencyLimiter::ptr &limiter() { return _limiter; }
+
+            // 处理时延的指数滑动平均，用于估计排队请求的执行耗时
+            void recordLatency(int64_t latency_us)
+            {
+                int64_t old = _latency_us.load(std::memory_order_relaxed);
+                _latency_us.store(old == 0 ? latency_us : old + (latency_us - old) / 8, std::memory_order_relaxed);
+            }
+
+            int64_t latency() { return _latency_us.load(std::memory_order_relaxed); }
+
+            void setLimiter(const ConcurrencyLimiter::ptr &limiter) { _limiter = limiter; }
+
+            // 是否合并相同参数的并发调用
+            bool collapsible() { return _collapsible; }
+
+            // 响应缓存，为空表示不缓存
+            const ResponseCache::ptr &cache() { return _cache; }
+            void setCache(const ResponseCache::ptr &cache) { _cache = cache; }
+            void setCollapsible(bool collapsible) { _collapsible = collapsible; }
+
+            /**
+             * @brief 构建一份配置相同、状态独立的描述，供另一个分片使用
+             * @details 限流器、时延统计、缓存、合并表与攒批器都不与本描述共享；不是由工厂构建的描述返回空
+             */
+            ptr fork()
+            {
+                return _forker ? _forker() : ptr();
+            }
+
+            void setForker(const std::function<ptr()> &forker) { _forker = forker; }
+
+            // 执行该方法的隔离线程池名称，为空表示使用默认工作线程池
+            const std::string &pool() { return _pool; }
+            void setPool(const std::string &pool) { _pool = pool; }
+            void recordCollapsed() { _collapsed.fetch_add(1, std::memory_order_relaxed); }
+            size_t collapsed() { return _collapsed.load(std::memory_order_relaxed); }
+
+        private:
+            // 执行攒好的一批请求，再按序号把结果分给各个请求
+            void callBatch(std::vector<RequestBatcher::Item> &items)
+            {
+                std::vector<Json::Value> params;
+                params.reserve(items.size());
+                for (auto &item : items)
+                {
+                    params.push_back(std::move(item.params));
+                }
+                std::vector<Json::Value> results;
+                _batch_callback(params, results);
+                if (results.size() != items.size())
+                {
+                    SUP_LOG_ERROR("{} 批处理回调返回了 {} 个结果，期望 {} 个", _method_name, results.size(), items.size());
+                    for (auto &item : items)
+                    {
+                        item.done(Json::Value(), RCode::RCODE_INTERNAL_ERROR);
+                    }
+                    return;
+                }
+                for (size_t i = 0; i < items.size(); ++i)
+                {
+                    if (rtypeCheck(results[i]) == false)
+                    {
+                        SUP_LOG_ERROR("{} 批处理回调中第 {} 个响应信息校验失败！", _method_name, i);
+                        items[i].done(Json::Value(), RCode::RCODE_INTERNAL_ERROR);
+                        continue;
+                    }
+                    items[i].done(results[i], RCode::RCODE_OK);
+                }
+            }
+
             bool check(VType type, const Json::Value &val)
             {
                 switch (type)
@@ -105,8 +598,21 @@ namespace suprpc
         private:
             std::string _method_name;                // 方法名称
             ServiceCallback _callback;               // 实际的业务回调函数
+            AsyncServiceCallback _async_callback;    // 异步业务回调函数
+            StreamServiceCallback _stream_callback;  // 流式业务回调函数
+            BidiServiceCallback _bidi_callback;      // 双向流业务回调函数
+            BatchServiceCallback _batch_callback;    // 批处理业务回调函数，五者只设置其一
+            RequestBatcher::ptr _batcher;            // 批处理方法的攒批器
+            int _stream_window = default_stream_window; // 双向流中服务端的接收窗口
             std::vector<ParamDescribe> _params_desc; // 参数字段格式描述
             VType _return_type;                      // 结果作为返回值的描述
+            ConcurrencyLimiter::ptr _limiter;        // 方法级别并发限制，为空表示不限制
+            std::atomic<int64_t> _latency_us{0};     // 平均处理时延
+            bool _collapsible = false;               // 是否合并相同参数的并发调用
+            ResponseCache::ptr _cache;               // 响应缓存，为空表示不缓存
+            std::atomic<size_t> _collapsed{0};       // 被合并而未执行业务回调的调用次数
+            std::string _pool;                       // 隔离线程池名称
+            std::function<ptr()> _forker;            // 重新构建本描述，见fork
         };
 
         /**
@@ -126,6 +632,45 @@ namespace suprpc
                 _callback = cb;
             }
 
+            void setAsyncCallback(const ServiceDescribe::AsyncServiceCallback &cb)
+            {
+                _async_callback = cb;
+            }
+
+            /**
+             * @brief 设置流式业务回调，结果通过写出器分多帧返回，不支持请求合并与响应缓存
+             */
+            void setStreamCallback(const ServiceDescribe::StreamServiceCallback &cb)
+            {
+                _stream_callback = cb;
+            }
+
+            /**
+             * @brief 设置双向流业务回调，不支持请求合并与响应缓存
+             * @details 回调在执行请求的线程中调用，流的读写会阻塞，业务应在工作线程或自己的线程中收发；
+             *          回调返回后仍需持有流直到close，流析构时以内部错误结束
+             * @param window 服务端的接收窗口(帧数)
+             */
+            void setBidiCallback(const ServiceDescribe::BidiServiceCallback &cb,
+                                 int window = default_stream_window)
+            {
+                _bidi_callback = cb;
+                _stream_window = window;
+            }
+
+            /**
+             * @brief 设置批处理业务回调：并发到达的请求攒成一批，一次回调处理多个请求的参数
+             * @details 适用于可以合并后端访问的方法(如按多个key一次读取)。攒够max_batch个请求，
+             *          或第一个请求等待了max_delay_us时执行一批；回调须按参数的顺序写出同样个数的结果
+             */
+            void setBatchCallback(const ServiceDescribe::BatchServiceCallback &cb,
+                                  size_t max_batch = 64, int max_delay_us = 1000)
+            {
+                _batch_callback = cb;
+                _batch_policy.max_batch = max_batch;
+                _batch_policy.max_delay_us = max_delay_us;
+            }
+
             void setParamsDesc(const std::string &pname, VType vtype)
             {
                 _params_desc.emplace_back(ServiceDescribe::ParamDescribe(pname, vtype));
@@ -141,56 +686,506 @@ namespace suprpc
                 _return_type = vtype;
             }
 
-            ServiceDescribe::ptr build()
+            /**
+             * @brief 开启方法级别的自适应并发限制
+             * @param max_limit 限制的上限，0表示不限制
+             */
+            void setConcurrencyLimit(size_t max_limit)
             {
-                return std::make_shared<ServiceDescribe>(
-                    std::move(_method_name),
-                    std::move(_params_desc),
-                    _return_type,
-                    std::move(_callback));
+                _concurrency_limit = max_limit;
+            }
+
+            /**
+             * @brief 开启请求合并：方法名与参数相同的并发调用共享一次业务回调的执行结果
+             * @details 只适用于没有副作用的读方法
+             */
+            void setCollapse(bool collapse)
+            {
+                _collapse = collapse;
+            }
+
+            /**
+             * @brief 开启响应缓存：ttl内参数相同的调用直接返回缓存的响应
+             * @details 只适用于结果只取决于参数、且允许在ttl内读到旧值的方法
+             */
+            void setCachePolicy(const CachePolicy &policy)
+            {
+                _cache_policy = policy;
+            }
+
+            /**
+             * @brief 把方法放进名为pool的隔离线程池执行，线程池由RpcRouter::addPool创建
+             * @details 慢方法占满自己的线程与队列时，其他线程池中的方法不受影响
+             */
+            void setPool(const std::string &pool)
+            {
+                _pool = pool;
+            }
+
+            /**
+             * @brief 构建服务描述，工厂本身不变，可以多次构建
+             * @details 描述记住工厂的一份拷贝，分片模式下每个分片由此构建状态独立的描述，见ServiceDescribe::fork
+             */
+            ServiceDescribe::ptr build() const
+            {
+                ServiceDescribe::ptr desc;
+                if (_bidi_callback)
+                {
+                    desc = std::make_shared<ServiceDescribe>(
+                        std::string(_method_name),
+                        std::vector<ServiceDescribe::ParamDescribe>(_params_desc),
+                        _return_type,
+                        ServiceDescribe::BidiServiceCallback(_bidi_callback));
+                    desc->setStreamWindow(_stream_window);
+                }
+                else if (_stream_callback)
+                {
+                    desc = std::make_shared<ServiceDescribe>(
+                        std::string(_method_name),
+                        std::vector<ServiceDescribe::ParamDescribe>(_params_desc),
+                        _return_type,
+                        ServiceDescribe::StreamServiceCallback(_stream_callback));
+                }
+                else if (_batch_callback)
+                {
+                    desc = std::make_shared<ServiceDescribe>(
+                        std::string(_method_name),
+                        std::vector<ServiceDescribe::ParamDescribe>(_params_desc),
+                        _return_type,
+                        ServiceDescribe::BatchServiceCallback(_batch_callback),
+                        _batch_policy);
+                }
+                else if (_async_callback)
+                {
+                    desc = std::make_shared<ServiceDescribe>(
+                        std::string(_method_name),
+                        std::vector<ServiceDescribe::ParamDescribe>(_params_desc),
+                        _return_type,
+                        ServiceDescribe::AsyncServiceCallback(_async_callback));
+                }
+                else
+                {
+                    desc = std::make_shared<ServiceDescribe>(
+                        std::string(_method_name),
+                        std::vector<ServiceDescribe::ParamDescribe>(_params_desc),
+                        _return_type,
+                        ServiceDescribe::ServiceCallback(_callback));
+                }
+                SvrDescbFactory factory = *this;
+                desc->setForker([factory]()
+                                { return factory.build(); });
+                if (_concurrency_limit > 0)
+                {
+                    desc->setLimiter(std::make_shared<ConcurrencyLimiter>(_concurrency_limit / 4, _concurrency_limit));
+                }
+                desc->setPool(_pool);
+                if (desc->isStream() || desc->isBidi())
+                {
+                    return desc;
+                }
+                desc->setCollapsible(_collapse);
+                if (_cache_policy.ttl_ms > 0)
+                {
+                    desc->setCache(std::make_shared<ResponseCache>(_cache_policy));
+                }
+                return desc;
             }
 
         private:
+            size_t _concurrency_limit = 0;
+            bool _collapse = false;
+            CachePolicy _cache_policy;
+            std::string _pool;
             std::string _method_name;
             ServiceDescribe::ServiceCallback _callback;
+            ServiceDescribe::AsyncServiceCallback _async_callback;
+            ServiceDescribe::StreamServiceCallback _stream_callback;
+            ServiceDescribe::BidiServiceCallback _bidi_callback;
+            ServiceDescribe::BatchServiceCallback _batch_callback;
+            BatchPolicy _batch_policy;
+            int _stream_window = default_stream_window;
             std::vector<ServiceDescribe::ParamDescribe> _params_desc;
             VType _return_type;
         };
 
         /**
-         * @class ServiceManager
-         * @brief 管理Service类的类
+         * @class BatchCollector
+         * @brief 批量请求的应答汇集器
+         * @details 批量中的每个调用以本对象作为连接走普通的处理流程，限流、缓存、合并与工作线程照常生效；
+         *          各调用的响应发到这里按序号归位，全部到齐后合成一帧发给真正的连接。
+         *          没有应答就结束的调用(如超过截止时间被丢弃)在汇集器析构时以超时补齐。
+         *          整个批量以批量id登记一个取消标记，作为其中各调用标记的上级；批量被取消后不再应答
          */
-        class ServiceManager
+        class BatchCollector : public BaseConnection
         {
         public:
-            using ptr = std::shared_ptr<ServiceManager>;
-            void insert(const ServiceDescribe::ptr &desc)
+            using ptr = std::shared_ptr<BatchCollector>;
+            using DoneCallback = std::function<void()>;
+            BatchCollector(const BaseConnection::ptr &conn, const RpcBatchRequest::ptr &request,
+                           const CancelToken::ptr &token = CancelToken::ptr(),
+                           const DoneCallback &done = DoneCallback())
+                : _conn(conn), _request(request), _token(token), _done(done), _slots(request->size()),
+                  _pending(request->size()), _sent(false) {}
+            ~BatchCollector()
             {
-                std::unique_lock<std::mutex> lock(_mutex);
-                _services.insert(std::make_pair(desc->method(), desc));
+                flush();
             }
 
-            ServiceDescribe::ptr select(const std::string &method_name)
+            // 批量中第index个调用的请求id
+            static std::string callId(const std::string &rid, size_t index)
             {
-                std::unique_lock<std::mutex> lock(_mutex);
+                return rid + '#' + std::to_string(index);
+            }
+
+            virtual void send(const BaseMessage::ptr &msg) override
+            {
+                auto rsp = std::dynamic_pointer_cast<RpcResponse>(msg);
+                size_t pos = msg->rid().rfind('#');
+                if (rsp.get() == nullptr || pos == std::string::npos)
+                {
+                    SUP_LOG_ERROR("批量请求 {} 收到无法归位的消息", _request->rid());
+                    return;
+                }
+                rsp->materialize(); // 缓存命中的响应只有序列化后的正文
+                fill(std::strtoul(msg->rid().c_str() + pos + 1, nullptr, 10), rsp->rcode(), rsp->result());
+            }
+
+            virtual void shutdown() override
+            {
+                _conn->shutdown();
+            }
+
+            virtual bool connected() override
+            {
+                return _conn->connected();
+            }
+
+            virtual bool congested() override
+            {
+                return _conn->congested();
+            }
+
+            // 批量中的调用计在真正的连接上
+            virtual void addPending(int delta) override
+            {
+                _conn->addPending(delta);
+            }
+
+            virtual int64_t pending() override
+            {
+                return _conn->pending();
+            }
+
+            // 整个批量的取消标记
+            const CancelToken::ptr &token() { return _token; }
+
+            /**
+             * @brief 填入第index个调用的结果，用于无法进入处理流程的调用
+             */
+            void fill(size_t index, RCode code, const Json::Value &result)
+            {
+                bool done = false;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    if (index >= _slots.size() || _slots[index].filled)
+                    {
+                        return;
+                    }
+                    _slots[index] = Slot{true, code, result};
+                    done = (--_pending == 0);
+                }
+                if (done)
+                    flush();
+            }
+
+        private:
+            void flush()
+            {
+                auto msg = MessageFactory::create<RpcBatchResponse>();
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    if (_sent)
+                    {
+                        return;
+                    }
+                    _sent = true;
+                    for (auto &slot : _slots)
+                    {
+                        if (slot.filled)
+                            msg->addResult(slot.code, slot.result);
+                        else
+                            msg->addResult(RCode::RCODE_TIMEOUT, Json::Value());
+                    }
+                }
+                if (_done)
+                    _done();
+                if (_token && _token->cancelled())
+                {
+                    return;
+                }
+                msg->setId(_request->rid());
+                msg->setMType(MType::RSP_RPC_BATCH);
+                msg->setRCode(RCode::RCODE_OK);
+                msg->setPriority(_request->priority());
+                _conn->send(msg);
+            }
+
+        private:
+            struct Slot
+            {
+                bool filled = false;
+                RCode code = RCode::RCODE_OK;
+                Json::Value result;
+            };
+            BaseConnection::ptr _conn;
+            RpcBatchRequest::ptr _request;
+            CancelToken::ptr _token;
+            DoneCallback _done;
+            std::mutex _mutex;
+            std::vector<Slot> _slots;
+            size_t _pending;
+            bool _sent;
+        };
+
+        /**
+         * @class RouteTable
+         * @brief 不可变的路由快照
+         * @details 发布后不再修改，读者无需加锁。冻结后的快照会重建为完美哈希表，
+         *          查找只需两次哈希与一次字符串比较
+         */
+        class RouteTable
+        {
+        public:
+            using ptr = std::shared_ptr<const RouteTable>;
+            using ServiceMap = std::unordered_map<std::string, ServiceDescribe::ptr>;
+
+            RouteTable(ServiceMap &&services, bool perfect) : _services(std::move(services)), _mask(0)
+            {
+                if (perfect && buildPerfect() == false)
+                {
+                    SUP_LOG_WARN("完美哈希构建失败，退回普通哈希表查找");
+                }
+            }
+
+            const ServiceDescribe::ptr &find(const std::string &method_name) const
+            {
+                static const ServiceDescribe::ptr empty;
+                if (_slots.empty() == false)
+                {
+                    size_t bucket = hash(method_name, 0) % _seeds.size();
+                    const ServiceDescribe::ptr &slot = _slots[hash(method_name, _seeds[bucket]) & _mask];
+                    if (slot && slot->method() == method_name)
+                    {
+                        return slot;
+                    }
+                    return empty;
+                }
                 auto it = _services.find(method_name);
                 if (it == _services.end())
                 {
-                    return ServiceDescribe::ptr();
+                    return empty;
                 }
                 return it->second;
             }
 
+            const ServiceMap &services() const { return _services; }
+
+            // 是否已重建为完美哈希表
+            bool perfect() const { return _slots.empty() == false; }
+
+        private:
+            // 带种子的FNV-1a，末尾再做一次混合让低位分布均匀
+            static uint64_t hash(const std::string &key, uint64_t seed)
+            {
+                uint64_t h = 14695981039346656037ULL ^ (seed * 0x9E3779B97F4A7C15ULL);
+                for (unsigned char c : key)
+                {
+                    h ^= c;
+                    h *= 1099511628211ULL;
+                }
+                h ^= h >> 33;
+                h *= 0xFF51AFD7ED558CCDULL;
+                h ^= h >> 33;
+                return h;
+            }
+
+            // 哈希-位移法：先按一级哈希分桶，再由大到小为每个桶寻找无冲突的位移种子
+            bool buildPerfect()
+            {
+                size_t n = _services.size();
+                if (n == 0)
+                {
+                    return true;
+                }
+                size_t m = 1;
+                while (m < 2 * n)
+                {
+                    m <<= 1;
+                }
+                std::vector<std::vector<const ServiceMap::value_type *>> buckets(n);
+                for (auto &kv : _services)
+                {
+                    buckets[hash(kv.first, 0) % n].push_back(&kv);
+                }
+                std::vector<size_t> order(n);
+                for (size_t i = 0; i < n; ++i)
+                {
+                    order[i] = i;
+                }
+                std::sort(order.begin(), order.end(), [&buckets](size_t a, size_t b)
+                          { return buckets[a].size() > buckets[b].size(); });
+
+                const uint32_t max_seed = 1 << 16;
+                std::vector<uint32_t> seeds(n, 0);
+                std::vector<ServiceDescribe::ptr> slots(m);
+                std::vector<size_t> pos;
+                for (size_t b : order)
+                {
+                    if (buckets[b].empty())
+                    {
+                        break;
+                    }
+                    uint32_t seed = 1;
+                    for (; seed < max_seed; ++seed)
+                    {
+                        pos.clear();
+                        bool ok = true;
+                        for (auto kv : buckets[b])
+                        {
+                            size_t idx = hash(kv->first, seed) & (m - 1);
+                            if (slots[idx] || std::find(pos.begin(), pos.end(), idx) != pos.end())
+                            {
+                                ok = false;
+                                break;
+                            }
+                            pos.push_back(idx);
+                        }
+                        if (ok)
+                        {
+                            break;
+                        }
+                    }
+                    if (seed == max_seed)
+                    {
+                        return false;
+                    }
+                    seeds[b] = seed;
+                    for (size_t i = 0; i < pos.size(); ++i)
+                    {
+                        slots[pos[i]] = buckets[b][i]->second;
+                    }
+                }
+                _seeds = std::move(seeds);
+                _slots = std::move(slots);
+                _mask = m - 1;
+                return true;
+            }
+
+        private:
+            ServiceMap _services;                    // 完整映射，写者复制时使用
+            std::vector<uint32_t> _seeds;            // 每个一级桶的位移种子
+            std::vector<ServiceDescribe::ptr> _slots; // 完美哈希槽，为空表示未冻结
+            size_t _mask;
+        };
+
+        /**
+         * @class ServiceManager
+         * @brief 管理Service类的类
+         * @details 读多写少：写者在锁内复制出新快照并原子替换，读者只读取一个版本号，
+         *          版本未变时直接拷贝线程本地缓存的快照，不加锁。读者持有快照期间，
+         *          其中的服务描述不会因并发的注册、注销或其他ServiceManager的查找而失效
+         */
+        class ServiceManager
+        {
+        public:
+            using ptr = std::shared_ptr<ServiceManager>;
+            ServiceManager() : _frozen(false), _version(nextVersion()),
+                               _table(std::make_shared<const RouteTable>(RouteTable::ServiceMap(), false))
+            {
+            }
+
+            void insert(const ServiceDescribe::ptr &desc)
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                RouteTable::ServiceMap services = std::atomic_load(&_table)->services();
+                services[desc->method()] = desc;
+                publish(std::move(services));
+            }
+
+            /**
+             * @brief 当前的路由表快照，从中查找得到的引用在快照释放前有效
+             */
+            RouteTable::ptr snapshot()
+            {
+                struct Cache
+                {
+                    uint64_t version = 0;
+                    RouteTable::ptr table;
+                };
+                static thread_local Cache cache;
+                uint64_t version = _version.load(std::memory_order_acquire);
+                if (cache.version != version)
+                {
+                    cache.table = std::atomic_load(&_table);
+                    cache.version = version;
+                }
+                return cache.table;
+            }
+
+            /**
+             * @brief 查找方法对应的服务描述，未找到时返回空指针
+             */
+            ServiceDescribe::ptr select(const std::string &method_name)
+            {
+                return snapshot()->find(method_name);
+            }
+
+            RouteTable::ServiceMap services()
+            {
+                return std::atomic_load(&_table)->services();
+            }
+
             void remove(const std::string &method_name)
             {
                 std::unique_lock<std::mutex> lock(_mutex);
-                _services.erase(method_name);
+                RouteTable::ServiceMap services = std::atomic_load(&_table)->services();
+                if (services.erase(method_name) == 0)
+                {
+                    return;
+                }
+                publish(std::move(services));
+            }
+
+            /**
+             * @brief 启动后方法集合基本固定，重建为完美哈希表；之后的注册依旧可用，会重新构建
+             */
+            void freeze()
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _frozen = true;
+                RouteTable::ServiceMap services = std::atomic_load(&_table)->services();
+                publish(std::move(services));
             }
 
         private:
-            std::mutex _mutex;
-            std::unordered_map<std::string, ServiceDescribe::ptr> _services;
+            // 版本号全局唯一，线程本地缓存无需区分属于哪个ServiceManager
+            static uint64_t nextVersion()
+            {
+                static std::atomic<uint64_t> seq(1);
+                return seq.fetch_add(1);
+            }
+
+            void publish(RouteTable::ServiceMap &&services)
+            {
+                std::atomic_store(&_table, RouteTable::ptr(std::make_shared<const RouteTable>(std::move(services), _frozen)));
+                _version.store(nextVersion(), std::memory_order_release);
+            }
+
+        private:
+            std::mutex _mutex; // 仅串行化写者
+            bool _frozen;
+            std::atomic<uint64_t> _version;
+            RouteTable::ptr _table;
         };
 
         /**
@@ -202,10 +1197,40 @@ namespace suprpc
         public:
             using ptr = std::shared_ptr<RpcRouter>;
             RpcRouter():_svr_manager(std::make_shared<ServiceManager>()){}
+
+            // 攒批中请求的完成回调引用本路由，先在路由仍然完整时结束它们
+            ~RpcRouter()
+            {
+                for (auto &kv : _svr_manager->services())
+                {
+                    if (kv.second->isBatch())
+                        kv.second->batcher()->shutdown();
+                }
+            }
+
             void onRpcRequest(const BaseConnection::ptr &conn,
                              std::shared_ptr<RpcRequest> &request)
             {
-                auto service = _svr_manager->select(request->method());
+                // 字段来自对端，类型不符时在访问之前拒绝
+                if (request->check() == false)
+                {
+                    SUP_LOG_ERROR("{} 请求格式错误", request->rid());
+                    return response(conn, request, Json::Value(), RCode::RCODE_INVALID_MSG);
+                }
+                if (request->expired())
+                {
+                    SUP_LOG_WARN("{} 请求已超过截止时间，直接丢弃", request->method());
+                    return;
+                }
+                // 连接缓冲超出进程内存预算时拒绝新请求，已建立的连接保持不断
+                if (MemoryBudget::instance().exceeded())
+                {
+                    SUP_LOG_WARN("连接缓冲占用超出内存预算，拒绝 {} 请求", request->method());
+                    return response(conn, request, Json::Value(), RCode::RCODE_OVERLOADED);
+                }
+                // 持有快照直到请求完成入队或执行，查找得到的引用始终有效
+                RouteTable::ptr routes = _svr_manager->snapshot();
+                const ServiceDescribe::ptr &service = routes->find(request->method());
                 if (service.get() == nullptr)
                 {
                     SUP_LOG_ERROR("{} 服务未找到", request->method());
@@ -218,37 +1243,641 @@ namespace suprpc
                     return response(conn, request, Json::Value(), RCode::RCODE_INVALID_PARAMS);
                 }
 
+                // 打开双向流的请求只能调用双向流方法，反之亦然
+                if (service->isBidi() != (request->window() > 0))
+                {
+                    SUP_LOG_ERROR("{} 调用方式与方法类型不匹配", request->method());
+                    return response(conn, request, Json::Value(), RCode::RCODE_ERROR_MSGTYPE);
+                }
+
+                if (service->cache())
+                {
+                    std::string body;
+                    if (service->cache()->get(canonicalParams(request), body))
+                    {
+                        return responseBody(conn, request, body);
+                    }
+                }
+
+                // 相同的调用正在执行时只登记等待其结果，不占并发名额
+                if (service->collapsible() &&
+                    _collapser.join(CallCollapser::keyOf(request), conn, request))
+                {
+                    service->recordCollapsed();
+                    conn->addPending(1);
+                    return;
+                }
+                admit(conn, request, service);
+            }
+
+            /**
+             * @brief 批量请求：拆成单个调用分别处理，结果汇集后一次应答
+             * @details 各调用在所属方法的线程池中并行执行，没有线程池时在IO线程中依次执行
+             */
+            void onRpcBatchRequest(const BaseConnection::ptr &conn,
+                                   std::shared_ptr<RpcBatchRequest> &batch)
+            {
+                if (batch->check() == false)
+                {
+                    SUP_LOG_ERROR("批量请求 {} 格式错误", batch->rid());
+                    auto msg = MessageFactory::create<RpcBatchResponse>();
+                    msg->setId(batch->rid());
+                    msg->setMType(MType::RSP_RPC_BATCH);
+                    msg->setRCode(RCode::RCODE_INVALID_MSG);
+                    msg->setPriority(batch->priority());
+                    return conn->send(msg);
+                }
+                if (batch->expired())
+                {
+                    SUP_LOG_WARN("批量请求 {} 已超过截止时间，直接丢弃", batch->rid());
+                    return;
+                }
+                // 取消帧携带的是批量id，以它登记的标记作为各调用标记的上级
+                std::string rid = batch->rid();
+                RouteTable::ptr routes = _svr_manager->snapshot();
+                auto collector = std::make_shared<BatchCollector>(conn, batch, _cancels.add(conn, rid),
+                                                                  [this, rid]()
+                                                                  { _cancels.remove(rid); });
+                BaseConnection::ptr sink = collector;
+                for (size_t i = 0; i < batch->size(); ++i)
+                {
+                    if (batch->callValid(i) == false)
+                    {
+                        SUP_LOG_ERROR("批量请求 {} 中第 {} 个调用格式错误", batch->rid(), i);
+                        collector->fill(i, RCode::RCODE_INVALID_MSG, Json::Value());
+                        continue;
+                    }
+                    auto request = MessageFactory::create<RpcRequest>();
+                    request->setId(BatchCollector::callId(batch->rid(), i));
+                    request->setMType(MType::REQ_RPC);
+                    request->setMethod(batch->callMethod(i));
+                    request->setParams(batch->callParams(i));
+                    request->setTimeout(batch->timeout());
+                    request->setTenant(batch->tenant());
+                    request->setPriority(batch->priority());
+                    // 流式方法的结果不是单个响应，不能放进批量
+                    const ServiceDescribe::ptr &service = routes->find(request->method());
+                    if (service && (service->isStream() || service->isBidi()))
+                    {
+                        collector->fill(i, RCode::RCODE_ERROR_MSGTYPE, Json::Value());
+                        continue;
+                    }
+                    onRpcRequest(sink, request);
+                }
+            }
+
+            void onCancelRequest(const BaseConnection::ptr &conn,
+                                 std::shared_ptr<CancelRequest> &msg)
+            {
+                if (_cancels.cancel(conn, msg->rid()))
+                {
+                    SUP_LOG_DEBUG("请求 {} 已被客户端取消", msg->rid());
+                }
+            }
+
+            /**
+             * @brief 双向流的帧，交给对应的流
+             */
+            void onStreamFrame(const BaseConnection::ptr &conn,
+                               std::shared_ptr<StreamFrame> &frame)
+            {
+                _streams.onFrame(conn, frame);
+            }
+
+            void registerMethod(const ServiceDescribe::ptr &service)
+            {
+                _svr_manager->insert(service);
+            }
+
+            /**
+             * @brief 方法注册完毕，固化路由表
+             */
+            void freeze()
+            {
+                for (auto &kv : _svr_manager->services())
+                {
+                    const std::string &pool = kv.second->pool();
+                    if (pool.empty() == false && _pools.find(pool) == _pools.end())
+                    {
+                        SUP_LOG_WARN("{} 方法的线程池 {} 不存在，使用默认工作线程池", kv.first, pool);
+                    }
+                    if (kv.second->isBatch() && poolOf(kv.second))
+                    {
+                        kv.second->batcher()->setExecutor(batchExecutor(poolOf(kv.second), kv.first));
+                    }
+                }
+                _svr_manager->freeze();
+            }
+
+            /**
+             * @brief 开启服务器级别的自适应并发限制，需在启动前调用
+             * @param max_limit 限制的上限
+             */
+            void setConcurrencyLimit(size_t max_limit)
+            {
+                _limiter = std::make_shared<ConcurrencyLimiter>(max_limit / 4, max_limit);
+            }
+
+            /**
+             * @brief 开启工作线程池，业务回调不再在IO线程中执行，需在启动前调用
+             * @param thread_num 工作线程数量
+             * @param policy 排队策略，EDF按剩余预算排序并提前淘汰无法按时完成的请求，
+             *               FAIR按租户标签(未声明时按连接)加权轮流出队
+             * @param max_queue 排队上限，超出时以过载拒绝
+             * @param cpus 工作线程依次绑定的CPU，为空表示不绑定
+             */
+            void setWorkerThreads(size_t thread_num, QueuePolicy policy = QueuePolicy::FIFO,
+                                  size_t max_queue = 10000,
+                                  const std::vector<int> &cpus = std::vector<int>())
+            {
+                _workers = std::make_shared<WorkerPool>(thread_num,
+                                                        QueueFactory::create(policy, max_queue, _fair_weights), cpus);
+            }
+
+            /**
+             * @brief 创建名为name的隔离线程池，需在启动前调用
+             * @details 通过SvrDescbFactory::setPool指定的方法在该池中排队与执行，
+             *          线程数与排队上限独立于默认工作线程池，参数含义同setWorkerThreads
+             */
+            void addPool(const std::string &name, size_t thread_num, QueuePolicy policy = QueuePolicy::FIFO,
+                         size_t max_queue = 10000,
+                         const std::vector<int> &cpus = std::vector<int>())
+            {
+                _pools[name] = std::make_shared<WorkerPool>(thread_num,
+                                                            QueueFactory::create(policy, max_queue, _fair_weights), cpus);
+            }
+
+            /**
+             * @brief 设置公平调度中租户的权重，需在setWorkerThreads与addPool之前调用
+             */
+            void setTenantWeight(const std::string &tenant, size_t weight)
+            {
+                _fair_weights[tenant] = weight;
+            }
+
+            /**
+             * @brief 已开始处理(排队或执行中)而尚未结束的请求数
+             */
+            size_t inflight()
+            {
+                return _inflight.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * @brief 运行指标快照
+             */
+            Json::Value metrics()
+            {
+                Json::Value val(Json::objectValue);
+                if (_limiter)
+                {
+                    val["limiter"] = _limiter->stats();
+                }
+                if (_workers)
+                {
+                    val["workers"] = _workers->stats();
+                }
+                for (auto &kv : _pools)
+                {
+                    val["pools"][kv.first] = kv.second->stats();
+                }
+                for (auto &kv : _svr_manager->services())
+                {
+                    Json::Value method(Json::objectValue);
+                    if (kv.second->limiter())
+                    {
+                        method["limiter"] = kv.second->limiter()->stats();
+                    }
+                    if (kv.second->collapsible())
+                    {
+                        method["collapsed"] = (Json::UInt64)kv.second->collapsed();
+                    }
+                    if (kv.second->cache())
+                    {
+                        method["cache"] = kv.second->cache()->stats();
+                    }
+                    if (kv.second->isBatch())
+                    {
+                        method["batch"] = kv.second->batcher()->stats();
+                    }
+                    val["methods"][kv.first] = method;
+                }
+                return val;
+            }
+
+        private:
+            // 攒好的一批请求作为一个任务提交到方法所属的线程池
+            static RequestBatcher::Executor batchExecutor(const WorkerPool::ptr &pool, const std::string &method)
+            {
+                return [pool, method](const std::function<void()> &run, const std::function<void()> &fail)
+                {
+                    RequestTask task;
+                    task.flow = "batch:" + method;
+                    task.run = run;
+                    task.reject = fail;
+                    if (pool->submit(std::move(task)) == false)
+                    {
+                        SUP_LOG_WARN("{} 请求队列已满，拒绝整批请求", method);
+                        fail();
+                    }
+                };
+            }
+
+            // 方法所属的线程池，未指定或不存在时为默认工作线程池，为空表示在IO线程中执行
+            const WorkerPool::ptr &poolOf(const ServiceDescribe::ptr &service)
+            {
+                if (service->pool().empty() == false)
+                {
+                    auto it = _pools.find(service->pool());
+                    if (it != _pools.end())
+                    {
+                        return it->second;
+                    }
+                }
+                return _workers;
+            }
+
+            // 通过合并检查的请求：占用并发名额后排队或直接执行
+            void admit(const BaseConnection::ptr &conn,
+                       const RpcRequest::ptr &request,
+                       const ServiceDescribe::ptr &service)
+            {
+                // 过载保护：先占服务器名额再占方法名额，拿不到则在执行前快速拒绝
+                if (_limiter && _limiter->tryAcquire() == false)
+                {
+                    SUP_LOG_WARN("{} 服务器并发达到限制，拒绝请求", request->method());
+                    return reply(conn, request, service, Json::Value(), RCode::RCODE_OVERLOADED);
+                }
+                const ConcurrencyLimiter::ptr &method_limiter = service->limiter();
+                if (method_limiter && method_limiter->tryAcquire() == false)
+                {
+                    if (_limiter)
+                        _limiter->cancel();
+                    SUP_LOG_WARN("{} 方法并发达到限制，拒绝请求", request->method());
+                    return reply(conn, request, service, Json::Value(), RCode::RCODE_OVERLOADED);
+                }
+                // 只有排队或异步执行的请求才有机会被取消帧追上；合并执行的结果还有其他请求在等待，不可取消
+                CancelToken::ptr token;
+                const WorkerPool::ptr &pool = poolOf(service);
+                if ((pool || service->isAsync() || service->isStream() || service->isBatch()) &&
+                    service->collapsible() == false)
+                {
+                    auto collector = std::dynamic_pointer_cast<BatchCollector>(conn);
+                    token = _cancels.add(conn, request->rid(), collector ? collector->token() : CancelToken::ptr());
+                }
+                _inflight.fetch_add(1, std::memory_order_relaxed);
+                conn->addPending(1);
+                if (pool)
+                {
+                    return schedule(pool, conn, request, service, token);
+                }
+                execute(conn, request, service, token);
+            }
+
+            void schedule(const WorkerPool::ptr &pool,
+                          const BaseConnection::ptr &conn,
+                          const RpcRequest::ptr &request,
+                          const ServiceDescribe::ptr &service,
+                          const CancelToken::ptr &token)
+            {
+                ServiceDescribe::ptr queued_service = service;
+                RequestTask task;
+                task.deadline = request->deadline();
+                task.cost_us = service->latency();
+                task.priority = request->priority();
+                task.tenant = request->tenant();
+                task.flow = task.tenant.empty() ? "conn:" + std::to_string((uintptr_t)conn.get())
+                                                : "tenant:" + task.tenant;
+                task.run = [this, conn, request, queued_service, token]()
+                {
+                    if (request->expired())
+                    {
+                        SUP_LOG_WARN("{} 请求出队时已超过截止时间，直接丢弃", request->method());
+                        release(conn, request, queued_service);
+                        return handoff(request, queued_service);
+                    }
+                    if (token && token->cancelled())
+                    {
+                        SUP_LOG_DEBUG("{} 请求出队时已被取消，直接丢弃", request->method());
+                        return release(conn, request, queued_service);
+                    }
+                    execute(conn, request, queued_service, token);
+                };
+                task.drop = [this, conn, request, queued_service]()
+                {
+                    SUP_LOG_WARN("{} 请求无法在截止时间前完成，出队时丢弃", request->method());
+                    release(conn, request, queued_service);
+                    // 截止时间尚未到达，立即应答超时，调用方不必干等到自己的超时
+                    response(conn, request, Json::Value(), RCode::RCODE_TIMEOUT);
+                    handoff(request, queued_service);
+                };
+                task.reject = [this, conn, request, queued_service]()
+                {
+                    SUP_LOG_WARN("{} 请求被积压更多的分组挤出队列，拒绝请求", request->method());
+                    release(conn, request, queued_service);
+                    response(conn, request, Json::Value(), RCode::RCODE_OVERLOADED);
+                    handoff(request, queued_service);
+                };
+                if (pool->submit(std::move(task)) == false)
+                {
+                    // 队列已满，等待同一结果的请求重新排队也会被拒绝，一并以过载应答
+                    SUP_LOG_WARN("{} 请求队列已满，拒绝请求", request->method());
+                    release(conn, request, service);
+                    return reply(conn, request, service, Json::Value(), RCode::RCODE_OVERLOADED);
+                }
+            }
+
+            // 请求未执行就结束时归还并发名额，不计入时延样本
+            void release(const BaseConnection::ptr &conn, const RpcRequest::ptr &request,
+                         const ServiceDescribe::ptr &service)
+            {
+                _cancels.remove(request->rid());
+                returnSlots(service);
+                conn->addPending(-1);
+                _inflight.fetch_sub(1, std::memory_order_relaxed);
+            }
+
+            // 合并调用的执行者未执行就结束，跟随者不随它一起失败：已过截止时间的不再应答，
+            // 其余推举一个重新申请名额执行，结果照常分发给剩下的跟随者
+            void handoff(const RpcRequest::ptr &request, const ServiceDescribe::ptr &service)
+            {
+                if (service->collapsible() == false)
+                {
+                    return;
+                }
+                std::string key = CallCollapser::keyOf(request);
+                std::vector<CallCollapser::Follower> waiting;
+                for (auto &follower : _collapser.take(key))
+                {
+                    if (follower.request->expired())
+                    {
+                        follower.conn->addPending(-1);
+                        continue;
+                    }
+                    waiting.push_back(std::move(follower));
+                }
+                CallCollapser::Follower leader;
+                if (waiting.empty() || _collapser.promote(key, std::move(waiting), leader) == false)
+                {
+                    return;
+                }
+                // 跟随时登记的待处理计数由admit重新登记
+                leader.conn->addPending(-1);
+                admit(leader.conn, leader.request, service);
+            }
+
+            // 归还服务器与方法的并发名额，不计入时延样本
+            void returnSlots(const ServiceDescribe::ptr &service)
+            {
+                if (service->limiter())
+                    service->limiter()->cancel();
+                if (_limiter)
+                    _limiter->cancel();
+            }
+
+            void execute(const BaseConnection::ptr &conn,
+                         const RpcRequest::ptr &request,
+                         const ServiceDescribe::ptr &service,
+                         const CancelToken::ptr &token)
+            {
+                auto start = std::chrono::steady_clock::now();
+                if (service->isAsync())
+                {
+                    // 应答器可能在其他线程完成，需要持有服务描述的拷贝
+                    ServiceDescribe::ptr async_service = service;
+                    auto responder = std::make_shared<Responder>(
+                        [this, conn, request, async_service, token, start](const Json::Value &result, RCode code)
+                        {
+                            if (code == RCode::RCODE_OK && async_service->rtypeCheck(result) == false)
+                            {
+                                SUP_LOG_ERROR("{} 异步回调的响应信息校验失败！", request->method());
+                                return finish(conn, request, async_service, token, start, Json::Value(), RCode::RCODE_INTERNAL_ERROR);
+                            }
+                            finish(conn, request, async_service, token, start, result, code);
+                        },
+                        token);
+                    return service->callAsync(request->params(), responder);
+                }
+                if (service->isBatch())
+                {
+                    // 结果在攒满一批的线程或攒批线程中返回，同样需要持有服务描述的拷贝
+                    ServiceDescribe::ptr batch_service = service;
+                    return service->callBatched(
+                        request->params(),
+                        [this, conn, request, batch_service, token, start](const Json::Value &result, RCode code)
+                        {
+                            finish(conn, request, batch_service, token, start, result, code);
+                        });
+                }
+                if (service->isStream())
+                {
+                    ServiceDescribe::ptr stream_service = service;
+                    auto writer = std::make_shared<StreamWriter>(
+                        conn, request,
+                        [this, conn, request, stream_service, token, start](RCode code)
+                        {
+                            finish(conn, request, stream_service, token, start, Json::Value(), code);
+                        },
+                        token);
+                    returnSlots(service);
+                    return service->callStream(request->params(), writer);
+                }
+                if (service->isBidi())
+                {
+                    // 客户端的窗口即服务端的初始发送信用；先登记再发出本端的信用，之后的帧才能找到流
+                    ServiceDescribe::ptr bidi_service = service;
+                    auto channel = std::make_shared<StreamChannel>(conn, request->rid(), service->streamWindow(),
+                                                                   request->window(), request->priority());
+                    channel->setCompleteCallback(
+                        [this, conn, request, bidi_service, token, start](RCode code)
+                        {
+                            _streams.remove(request->rid());
+                            finish(conn, request, bidi_service, token, start, Json::Value(), code);
+                        });
+                    _streams.add(conn, channel);
+                    channel->accept();
+                    returnSlots(service);
+                    return service->callBidi(request->params(), channel);
+                }
+
                 Json::Value result;
                 bool ret = service->call(request->params(), result);
                 if (ret == false)
                 {
                     SUP_LOG_ERROR("{} 服务器出现内部错误", request->method());
-                    return response(conn, request, Json::Value(), RCode::RCODE_INTERNAL_ERROR);
+                    return finish(conn, request, service, token, start, Json::Value(), RCode::RCODE_INTERNAL_ERROR);
                 }
-                return response(conn, request, Json::Value(), RCode::RCODE_OK);
+                finish(conn, request, service, token, start, result, RCode::RCODE_OK);
             }
 
-            void registerMethod(const ServiceDescribe::ptr &service)
+            // 一次调用的收尾：归还并发名额、反馈时延，再发送响应；已取消的请求不再响应。
+            // 流的名额在建立时已归还，流的持续时间也不作为时延样本，否则会压低普通调用的并发上限
+            void finish(const BaseConnection::ptr &conn,
+                        const RpcRequest::ptr &request,
+                        const ServiceDescribe::ptr &service,
+                        const CancelToken::ptr &token,
+                        std::chrono::steady_clock::time_point start,
+                        const Json::Value &result,
+                        RCode code)
             {
-                _svr_manager->insert(service);
+                int64_t latency_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                                         std::chrono::steady_clock::now() - start)
+                                         .count();
+                bool ok = (code != RCode::RCODE_OVERLOADED && code != RCode::RCODE_TIMEOUT);
+                if (service->isStream() == false && service->isBidi() == false)
+                {
+                    service->recordLatency(latency_us);
+                    if (service->limiter())
+                        service->limiter()->release(latency_us, ok);
+                    if (_limiter)
+                        _limiter->release(latency_us, ok);
+                }
+                if (token)
+                {
+                    _cancels.remove(request->rid());
+                }
+                // 双向流的结果已随结束帧发出
+                if ((token == nullptr || token->cancelled() == false) && service->isBidi() == false)
+                {
+                    reply(conn, request, service, result, code);
+                }
+                conn->addPending(-1);
+                _inflight.fetch_sub(1, std::memory_order_relaxed);
+            }
+
+            // 应答请求本身以及合并到它上面的全部请求
+            void reply(const BaseConnection::ptr &conn,
+                       const RpcRequest::ptr &request,
+                       const ServiceDescribe::ptr &service,
+                       const Json::Value &result,
+                       RCode code)
+            {
+                if (service->isStream())
+                {
+                    return endStream(conn, request, code);
+                }
+                if (service->isBidi())
+                {
+                    return response(conn, request, Json::Value(), code);
+                }
+                if (service->cache() && code == RCode::RCODE_OK)
+                {
+                    // 只序列化一次，同时用于缓存与本次的全部应答
+                    auto msg = MessageFactory::create<RpcResponse>();
+                    msg->setRCode(code);
+                    msg->setResult(result);
+                    std::string body = msg->serialize();
+                    service->cache()->put(canonicalParams(request), body);
+                    responseBody(conn, request, body);
+                    if (service->collapsible())
+                    {
+                        for (auto &follower : _collapser.take(CallCollapser::keyOf(request)))
+                        {
+                            responseBody(follower.conn, follower.request, body);
+                            follower.conn->addPending(-1);
+                        }
+                    }
+                    return;
+                }
+                response(conn, request, result, code);
+                if (service->collapsible())
+                    replyFollowers(request, result, code);
+            }
+
+            static std::string canonicalParams(const RpcRequest::ptr &request)
+            {
+                std::string params;
+                JSON::serialize(request->params(), params);
+                return params;
+            }
+
+            void replyFollowers(const RpcRequest::ptr &request, const Json::Value &result, RCode code)
+            {
+                for (auto &follower : _collapser.take(CallCollapser::keyOf(request)))
+                {
+                    response(follower.conn, follower.request, result, code);
+                    follower.conn->addPending(-1);
+                }
             }
 
-        private:
             void response(const BaseConnection::ptr &conn,
                           const RpcRequest::ptr &req,
                           const Json::Value &res,
                           RCode code)
             {
+                if (req->oneway())
+                {
+                    return;
+                }
+                if (req->expired())
+                {
+                    SUP_LOG_WARN("{} 处理完成时已超过截止时间，不再发送响应", req->method());
+                    return;
+                }
+                // 打开双向流的请求在流建立之前被拒绝，以结束帧应答
+                if (req->window() > 0)
+                {
+                    return StreamChannel::reject(conn, req->rid(), code, req->priority());
+                }
                 auto msg = MessageFactory::create<RpcResponse>();
                 msg->setId(req->rid());
                 msg->setMType(suprpc::MType::RSP_RPC);
                 msg->setRCode(code);
                 msg->setResult(res);
+                msg->setPriority(req->priority());
+                conn->send(msg);
+            }
+
+            // 流式调用的结束帧，状态码即整个调用的结果
+            void endStream(const BaseConnection::ptr &conn,
+                           const RpcRequest::ptr &req,
+                           RCode code)
+            {
+                if (req->oneway() || req->expired())
+                {
+                    return;
+                }
+                auto msg = MessageFactory::create<RpcStreamResponse>();
+                msg->setId(req->rid());
+                msg->setMType(suprpc::MType::RSP_RPC_STREAM);
+                msg->setRCode(code);
+                msg->setEos(true);
+                msg->setPriority(req->priority());
+                conn->send(msg);
+            }
+
+            // 以已序列化的响应正文应答
+            void responseBody(const BaseConnection::ptr &conn,
+                              const RpcRequest::ptr &req,
+                              const std::string &body)
+            {
+                if (req->oneway())
+                {
+                    return;
+                }
+                if (req->expired())
+                {
+                    SUP_LOG_WARN("{} 处理完成时已超过截止时间，不再发送响应", req->method());
+                    return;
+                }
+                auto msg = MessageFactory::create<RpcResponse>();
+                msg->setId(req->rid());
+                msg->setMType(suprpc::MType::RSP_RPC);
+                msg->setSerializedBody(body);
+                msg->setPriority(req->priority());
                 conn->send(msg);
             }
 
         private:
             ServiceManager::ptr _svr_manager;
+            ConcurrencyLimiter::ptr _limiter; // 服务器级别并发限制，为空表示不限制
+            CancelRegistry _cancels;
+            CallCollapser _collapser;
+            StreamRegistry _streams;
+            std::atomic<size_t> _inflight{0};
+            FairWeights _fair_weights;
+            WorkerPool::ptr _workers;         // 为空表示在IO线程中直接执行；最后析构，先停下仍在执行的任务
+            std::unordered_map<std::string, WorkerPool::ptr> _pools; // 隔离线程池，同样先于其他成员析构
         };
     }
 }
\ No newline at end of file
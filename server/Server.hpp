@@ -9,9 +9,13 @@
  #include "./Service.hpp"
  #include "./RpcRouter.hpp"
  #include "./Topic.hpp"
+ #include <thread>
 
  namespace suprpc{
     namespace server{
+        // 热重启排空完成后，留给最后一批响应写出的时间
+        const int hot_restart_grace_ms = 100;
+
         /**
          * @class RegisterServer
          * @brief 注册服务类
@@ -20,6 +24,7 @@
             public:
                 using ptr = std::shared_ptr<RegistryServer>;
                 RegistryServer(int port):
+                    _port(port),
                     _pd_manager(std::make_shared<PDManager>()),
                     _dispatcher(std::make_shared<Dispatcher>())
                 {
@@ -41,14 +46,47 @@
 
                 }
 
+                /**
+                 * @brief 开启热重启，需在start之前调用
+                 * @details 启动时若path上有旧进程，接管它的监听套接字；之后在path上等待下一个新进程，
+                 *          交出监听套接字后停止读取请求并退出，start随之返回
+                 */
+                void enableHotRestart(const std::string &path){
+                    _restart_path = path;
+                }
+
+                /**
+                 * @brief 关闭连续timeout_sec秒没有收发的连接，需在start之前调用
+                 * @details 未发FIN就消失的提供者与发现者随连接关闭而下线，释放其记录与文件描述符。
+                 *          注册后的连接平时静默，提供者与发现者须以小于timeout_sec的间隔setHeartbeat，
+                 *          否则健康的节点也会被下线
+                 */
+                void setIdleTimeout(int timeout_sec){
+                    _server->setIdleTimeout(timeout_sec);
+                }
+
                 void start(){
+                    if(_restart_path.empty() == false) {
+                        HotRestart::instance().inherit(_restart_path);
+                        HotRestart::instance().serve(_restart_path, _port,
+                            std::bind(&RegistryServer::onHandoff, this));
+                    }
                     _server->start();
                 }
             private:
                 void onConnShutdown(const BaseConnection::ptr&conn){
                     _pd_manager->onConnShutdown(conn);
                 }
+
+                // 注册请求在IO线程中同步处理，停止读取后即可退出
+                void onHandoff(){
+                    _server->drain();
+                    std::this_thread::sleep_for(std::chrono::milliseconds(hot_restart_grace_ms));
+                    _server->quit();
+                }
             private:
+            int _port;
+            std::string _restart_path;
             PDManager::ptr _pd_manager;
             Dispatcher::ptr _dispatcher;
             BaseServer::ptr _server;
@@ -66,6 +104,16 @@
                 const Address &registry_server_addr = Address()):
                 _enableRegistry(enableRegistry),
                 _access_addr(access_addr),
+                _shard_num(1),
+                _high_water_mark(default_high_water_mark),
+                _max_frame_size(default_max_frame_size),
+                _idle_timeout_sec(0),
+                _concurrency_limit(0),
+                _worker_threads(0),
+                _queue_policy(QueuePolicy::FIFO),
+                _max_queue(0),
+                _busy_poll_us(0),
+                _drain_timeout_ms(0),
                 _router(std::make_shared<suprpc::server::RpcRouter>()),
                 _dispatcher(std::make_shared<suprpc::Dispatcher>())
                 {
@@ -80,6 +128,21 @@
                     _dispatcher->registerHandler<suprpc::RpcRequest>(
                         suprpc::MType::REQ_RPC,rpc_cb
                     );
+                    auto batch_cb = std::bind(&RpcRouter::onRpcBatchRequest,_router.get(),
+                        std::placeholders::_1,std::placeholders::_2);
+                    _dispatcher->registerHandler<suprpc::RpcBatchRequest>(
+                        suprpc::MType::REQ_RPC_BATCH,batch_cb
+                    );
+                    auto cancel_cb = std::bind(&RpcRouter::onCancelRequest,_router.get(),
+                        std::placeholders::_1,std::placeholders::_2);
+                    _dispatcher->registerHandler<suprpc::CancelRequest>(
+                        suprpc::MType::REQ_CANCEL,cancel_cb
+                    );
+                    auto frame_cb = std::bind(&RpcRouter::onStreamFrame,_router.get(),
+                        std::placeholders::_1,std::placeholders::_2);
+                    _dispatcher->registerHandler<suprpc::StreamFrame>(
+                        suprpc::MType::STREAM_FRAME,frame_cb
+                    );
 
                     _server = suprpc::ServerFactory::create(access_addr.second);
                     auto message_cb = std::bind(&Dispatcher::onMessage,_dispatcher.get(),
@@ -87,20 +150,363 @@
                     _server->setMessageCallback(message_cb);
                 }
 
+                ~RpcServer() {
+                    for(auto &thread : _shard_threads) {
+                        if(thread.joinable()) thread.join();
+                    }
+                }
+
+                /**
+                 * @brief 与注册中心的连接空闲interval_sec秒时发送心跳，注册中心开启空闲回收时须小于其回收时间
+                 */
+                void setRegistryHeartbeat(int interval_sec) {
+                    if(_enableRegistry) {
+                        _reg_client->setHeartbeat(interval_sec);
+                    }
+                }
+
                 void registerMethod(const ServiceDescribe::ptr &service) {
                     if(_enableRegistry) {
                         _reg_client->registryMethod(service->method(),_access_addr);
                     }
                     _router->registerMethod(service);
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _services.push_back(service);
+                    for(auto &router : _shard_routers) {
+                        router->registerMethod(shardService(service));
+                    }
+                }
+
+                /**
+                 * @brief 设置分片数量，需在start之前调用
+                 * @details 每个分片拥有独立的监听套接字(SO_REUSEPORT)、事件循环、分发器与路由，
+                 *          分片之间不共享状态，由内核在各分片之间分摊新连接
+                 */
+                void setShardNum(int shard_num) {
+                    _shard_num = shard_num < 1 ? 1 : shard_num;
+                }
+
+                /**
+                 * @brief 设置单个连接输出缓冲的高水位，超过后暂停读取该连接
+                 */
+                void setHighWaterMark(size_t mark) {
+                    _high_water_mark = mark;
+                    _server->setHighWaterMark(mark);
+                }
+
+                /**
+                 * @brief 设置单个报文的长度上限，即每个连接输入缓冲中未处理数据的上限，超过后断开连接
+                 */
+                void setMaxFrameSize(size_t size) {
+                    _max_frame_size = size;
+                    _server->setMaxFrameSize(size);
+                }
+
+                /**
+                 * @brief 关闭连续timeout_sec秒没有收发的连接，需在start之前调用，0表示不回收
+                 * @details 仍有请求在排队、执行或流未结束的连接不会被关闭；
+                 *          长时间静默的客户端须以小于timeout_sec的间隔setHeartbeat
+                 */
+                void setIdleTimeout(int timeout_sec) {
+                    _idle_timeout_sec = timeout_sec;
+                    _server->setIdleTimeout(timeout_sec);
+                }
+
+                /**
+                 * @brief 设置进程内所有连接缓冲占用的预算，0表示不限制
+                 * @details 超出预算后新请求以RCODE_OVERLOADED拒绝而不是断开连接；
+                 *          单个连接的输出缓冲仍由高水位限制
+                 */
+                void setMemoryBudget(size_t bytes) {
+                    MemoryBudget::instance().setLimit(bytes);
+                }
+
+                /**
+                 * @brief 开启服务器级别的自适应并发限制，各分片分别限制
+                 */
+                void setConcurrencyLimit(size_t max_limit) {
+                    _concurrency_limit = max_limit;
+                    _router->setConcurrencyLimit(max_limit);
+                }
+
+                /**
+                 * @brief 开启工作线程池，需在start之前调用；分片模式下每个分片各自拥有一组工作线程
+                 */
+                void setWorkerThreads(size_t thread_num, QueuePolicy policy = QueuePolicy::FIFO,
+                                      size_t max_queue = 10000) {
+                    _worker_threads = thread_num;
+                    _queue_policy = policy;
+                    _max_queue = max_queue;
+                }
+
+                /**
+                 * @brief 创建名为name的隔离线程池，需在start之前调用；分片模式下每个分片各自拥有一组
+                 * @details 通过SvrDescbFactory::setPool指定的方法在该池中排队与执行，
+                 *          一组方法占满自己的线程与队列时不会拖慢其他方法
+                 */
+                void addPool(const std::string &name, size_t thread_num,
+                             QueuePolicy policy = QueuePolicy::FIFO, size_t max_queue = 10000) {
+                    _pools.push_back(PoolConfig{name, thread_num, policy, max_queue});
+                }
+
+                /**
+                 * @brief 开启热重启，需在start之前调用
+                 * @details 启动时若path上有旧进程，接管它的全部监听套接字(分片数不足时补足)；
+                 *          之后在path上等待下一个新进程，交出监听套接字后不再accept，停止读取新请求，
+                 *          等排队与执行中的请求全部应答(最多drain_timeout_ms)后退出，start随之返回
+                 */
+                void enableHotRestart(const std::string &path, int drain_timeout_ms = 30000) {
+                    _restart_path = path;
+                    _drain_timeout_ms = drain_timeout_ms;
+                }
+
+                /**
+                 * @brief 设置租户在公平调度(QueuePolicy::FAIR)中的权重，需在start之前调用
+                 * @details 租户由客户端在CallOptions::tenant中声明，未配置的租户与未声明租户的连接权重为1
+                 */
+                void setTenantWeight(const std::string &tenant, size_t weight) {
+                    _fair_weights[tenant] = weight;
+                }
+
+                /**
+                 * @brief 开启绑核，需在start之前调用
+                 * @details 按顺序为每个分片分配1+工作线程数+隔离线程池线程数个CPU：第一个给事件循环，
+                 *          其后依次给该分片的工作线程与各隔离线程池。第0号分片的事件循环运行在调用start的线程中，
+                 *          该线程只在事件循环运行期间绑核，start返回前恢复原有的CPU集合。默认顺序按NUMA节点排列，一个分片的线程因此尽量落在同一节点上；
+                 *          分片线程在创建自身对象之前绑核，其内存按首次访问分配在本地节点
+                 * @param cpus 绑核顺序，个数不足时循环使用
+                 */
+                void setCpuAffinity(const std::vector<int> &cpus = CpuTopology::instance().defaultLayout()) {
+                    _cpus = cpus;
+                }
+
+                /**
+                 * @brief 开启忙轮询，需在start之前调用
+                 * @details 各分片的事件循环在最近一次收发后的spin_us微秒内不再睡眠，
+                 *          省去请求到达时的唤醒时延，代价是窗口内占满一个核；0表示关闭
+                 */
+                void setBusyPoll(int64_t spin_us) {
+                    _busy_poll_us = spin_us;
+                    _server->setBusyPoll(spin_us);
+                }
+
+                /**
+                 * @brief 运行指标，分片模式下第0号分片之外的分片放在shards数组中
+                 */
+                Json::Value metrics() {
+                    Json::Value val = _router->metrics();
+                    val["memory"]["used"] = (Json::UInt64)MemoryBudget::instance().used();
+                    val["memory"]["limit"] = (Json::UInt64)MemoryBudget::instance().limit();
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    for(auto &router : _shard_routers) {
+                        val["shards"].append(router->metrics());
+                    }
+                    return val;
                 }
 
                 void start() {
-                    _server->start();
+                    for(auto &weight : _fair_weights) {
+                        _router->setTenantWeight(weight.first, weight.second);
+                    }
+                    if(_worker_threads > 0) {
+                        _router->setWorkerThreads(_worker_threads, _queue_policy, _max_queue, workerCpus(0));
+                    }
+                    for(size_t i = 0; i < _pools.size(); ++i) {
+                        _router->addPool(_pools[i].name, _pools[i].thread_num, _pools[i].policy,
+                            _pools[i].max_queue, poolCpus(0, i));
+                    }
+                    _router->freeze();
+                    if(_restart_path.empty() == false) {
+                        int inherited = (int)HotRestart::instance().inherit(_restart_path);
+                        if(inherited > _shard_num) {
+                            SUP_LOG_WARN("旧进程有 {} 个监听套接字，分片数从 {} 调整为 {}", inherited, _shard_num, inherited);
+                            _shard_num = inherited;
+                        }
+                    }
+                    for(int i = 1; i < _shard_num; ++i) {
+                        _shard_threads.emplace_back(&RpcServer::runShard, this, i);
+                    }
+                    if(_restart_path.empty() == false) {
+                        HotRestart::instance().serve(_restart_path, _access_addr.second,
+                            std::bind(&RpcServer::onHandoff, this));
+                    }
+                    _server->setCpuAffinity(loopCpu(0));
+                    _server->start(); // 第0号分片运行在调用线程
+                }
+
+            private:
+                // 在交接线程中执行：不再accept，停止读取，等待已收到的请求处理完毕后退出全部分片
+                void onHandoff() {
+                    std::vector<BaseServer*> servers;
+                    {
+                        std::unique_lock<std::mutex> lock(_mutex);
+                        servers = _shard_servers;
+                    }
+                    servers.push_back(_server.get());
+                    for(auto &server : servers) {
+                        server->drain();
+                    }
+                    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(_drain_timeout_ms);
+                    while(inflight() > 0 && std::chrono::steady_clock::now() < deadline) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                    }
+                    if(inflight() > 0) {
+                        SUP_LOG_WARN("排空超时，仍有 {} 个请求未完成", inflight());
+                    }
+                    std::this_thread::sleep_for(std::chrono::milliseconds(hot_restart_grace_ms));
+                    for(auto &server : servers) {
+                        server->quit();
+                    }
+                }
+
+                size_t inflight() {
+                    size_t total = _router->inflight();
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    for(auto &router : _shard_routers) {
+                        total += router->inflight();
+                    }
+                    return total;
+                }
+
+                // 每个分片占用的CPU个数：事件循环、工作线程与各隔离线程池的线程
+                size_t shardStride() {
+                    size_t stride = 1 + _worker_threads;
+                    for(auto &pool : _pools) {
+                        stride += pool.thread_num;
+                    }
+                    return stride;
+                }
+
+                int loopCpu(int shard) {
+                    return Affinity::pick(_cpus, shard * shardStride());
+                }
+
+                std::vector<int> cpuRange(int shard, size_t offset, size_t count) {
+                    std::vector<int> cpus;
+                    for(size_t i = 0; _cpus.empty() == false && i < count; ++i) {
+                        cpus.push_back(Affinity::pick(_cpus, shard * shardStride() + offset + i));
+                    }
+                    return cpus;
+                }
+
+                std::vector<int> workerCpus(int shard) {
+                    return cpuRange(shard, 1, _worker_threads);
+                }
+
+                // 隔离线程池排在工作线程之后，按addPool的顺序依次分配
+                std::vector<int> poolCpus(int shard, size_t index) {
+                    size_t offset = 1 + _worker_threads;
+                    for(size_t i = 0; i < index; ++i) {
+                        offset += _pools[i].thread_num;
+                    }
+                    return cpuRange(shard, offset, _pools[index].thread_num);
+                }
+
+                // 分片各自使用由工厂重新构建的描述，方法级别的限流、缓存与攒批状态不在分片之间共享
+                static ServiceDescribe::ptr shardService(const ServiceDescribe::ptr &service) {
+                    ServiceDescribe::ptr forked = service->fork();
+                    if(forked.get() == nullptr) {
+                        SUP_LOG_WARN("{} 方法不是由SvrDescbFactory构建的，各分片共享同一描述", service->method());
+                        return service;
+                    }
+                    return forked;
+                }
+
+                // EventLoop必须在运行它的线程中构造，因此分片的所有对象都在分片线程内创建
+                void runShard(int shard) {
+                    Affinity::pinCurrentThread(loopCpu(shard));
+                    auto router = std::make_shared<suprpc::server::RpcRouter>();
+                    if(_concurrency_limit > 0) {
+                        router->setConcurrencyLimit(_concurrency_limit);
+                    }
+                    for(auto &weight : _fair_weights) {
+                        router->setTenantWeight(weight.first, weight.second);
+                    }
+                    if(_worker_threads > 0) {
+                        router->setWorkerThreads(_worker_threads, _queue_policy, _max_queue, workerCpus(shard));
+                    }
+                    for(size_t i = 0; i < _pools.size(); ++i) {
+                        router->addPool(_pools[i].name, _pools[i].thread_num, _pools[i].policy,
+                            _pools[i].max_queue, poolCpus(shard, i));
+                    }
+                    {
+                        std::unique_lock<std::mutex> lock(_mutex);
+                        for(auto &service : _services) {
+                            router->registerMethod(shardService(service));
+                        }
+                        _shard_routers.push_back(router);
+                    }
+                    router->freeze();
+
+                    auto dispatcher = std::make_shared<suprpc::Dispatcher>();
+                    auto rpc_cb = std::bind(&RpcRouter::onRpcRequest,router.get(),
+                        std::placeholders::_1,std::placeholders::_2);
+                    dispatcher->registerHandler<suprpc::RpcRequest>(
+                        suprpc::MType::REQ_RPC,rpc_cb
+                    );
+                    auto batch_cb = std::bind(&RpcRouter::onRpcBatchRequest,router.get(),
+                        std::placeholders::_1,std::placeholders::_2);
+                    dispatcher->registerHandler<suprpc::RpcBatchRequest>(
+                        suprpc::MType::REQ_RPC_BATCH,batch_cb
+                    );
+                    auto cancel_cb = std::bind(&RpcRouter::onCancelRequest,router.get(),
+                        std::placeholders::_1,std::placeholders::_2);
+                    dispatcher->registerHandler<suprpc::CancelRequest>(
+                        suprpc::MType::REQ_CANCEL,cancel_cb
+                    );
+                    auto frame_cb = std::bind(&RpcRouter::onStreamFrame,router.get(),
+                        std::placeholders::_1,std::placeholders::_2);
+                    dispatcher->registerHandler<suprpc::StreamFrame>(
+                        suprpc::MType::STREAM_FRAME,frame_cb
+                    );
+
+                    auto server = suprpc::ServerFactory::create(_access_addr.second);
+                    server->setHighWaterMark(_high_water_mark);
+                    server->setMaxFrameSize(_max_frame_size);
+                    server->setIdleTimeout(_idle_timeout_sec);
+                    server->setBusyPoll(_busy_poll_us);
+                    auto message_cb = std::bind(&Dispatcher::onMessage,dispatcher.get(),
+                    std::placeholders::_1,std::placeholders::_2);
+                    server->setMessageCallback(message_cb);
+                    {
+                        std::unique_lock<std::mutex> lock(_mutex);
+                        _shard_servers.push_back(server.get());
+                    }
+                    server->start();
+                    // muduo要求TcpServer在事件循环线程中析构，服务器随分片线程结束
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _shard_servers.erase(std::find(_shard_servers.begin(), _shard_servers.end(), server.get()));
                 }
 
             private:
+                struct PoolConfig {
+                    std::string name;
+                    size_t thread_num;
+                    QueuePolicy policy;
+                    size_t max_queue;
+                };
+
                 bool _enableRegistry;
                 Address _access_addr;
+                int _shard_num;
+                size_t _high_water_mark;
+                size_t _max_frame_size;
+                int _idle_timeout_sec;
+                size_t _concurrency_limit;
+                size_t _worker_threads;
+                QueuePolicy _queue_policy;
+                size_t _max_queue;
+                std::vector<PoolConfig> _pools;
+                int64_t _busy_poll_us;
+                std::vector<int> _cpus;
+                FairWeights _fair_weights;
+                std::string _restart_path;
+                int _drain_timeout_ms;
+                std::mutex _mutex; // 保护_services、_shard_routers与_shard_servers
+                std::vector<ServiceDescribe::ptr> _services;
+                std::vector<RpcRouter::ptr> _shard_routers;
+                std::vector<BaseServer*> _shard_servers; // 仅供热重启时排空与退出，由分片线程持有
+                std::vector<std::thread> _shard_threads;
                 RpcRouter::ptr _router;
                 Dispatcher::ptr _dispatcher;
                 client::RegistryClient::ptr _reg_client;
@@ -206,6 +206,12 @@ namespace suprpc
                     std::unique_lock<std::mutex> lock(_mutex);
                     for (auto &subscriber : _subscribers)
                     {
+                        // 跟不上的订阅者直接丢弃本条消息，避免输出缓冲无限增长
+                        if (subscriber->_conn->congested())
+                        {
+                            SUP_LOG_WARN("主题 {} 的订阅者输出缓冲拥塞，丢弃本条消息", _topic_name);
+                            continue;
+                        }
                         subscriber->_conn->send(msg);
                     }
                 }
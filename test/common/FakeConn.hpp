@@ -0,0 +1,68 @@
+/**
+ * @file FakeConn.hpp
+ * @brief 测试共用的假连接：记录发出的全部消息，不经过网络
+ */
+#pragma once
+#include "../../common/Base.hpp"
+#include "../../common/Message.hpp"
+#include <cassert>
+#include <mutex>
+#include <vector>
+
+namespace suprpc
+{
+    namespace test
+    {
+        /**
+         * @class FakeConn
+         * @brief 发出的消息按顺序保存在sent中，可以在工作线程中发送
+         */
+        struct FakeConn : public BaseConnection
+        {
+            using ptr = std::shared_ptr<FakeConn>;
+            std::mutex mutex;
+            std::vector<BaseMessage::ptr> sent;
+
+            void send(const BaseMessage::ptr &msg) override
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                sent.push_back(msg);
+            }
+            void shutdown() override {}
+            bool connected() override { return true; }
+            bool congested() override { return false; }
+
+            size_t count()
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                return sent.size();
+            }
+
+            void clear()
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                sent.clear();
+            }
+
+            // 最近发出的一条消息，没有时返回空指针
+            BaseMessage::ptr last()
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                return sent.empty() ? BaseMessage::ptr() : sent.back();
+            }
+
+            template <typename T>
+            std::shared_ptr<T> lastAs()
+            {
+                return std::dynamic_pointer_cast<T>(last());
+            }
+
+            RCode lastRCode()
+            {
+                auto rsp = lastAs<RpcResponse>();
+                assert(rsp);
+                return rsp->rcode();
+            }
+        };
+    }
+}
@@ -0,0 +1,35 @@
+#include "../../common/JsonConcrete.hpp"
+#include "../../client/Client.hpp"
+#include <algorithm>
+
+// 乒乓测试客户端：串行发起同步调用，统计单次往返时延的分位数
+// 用法: ./client [忙轮询窗口(微秒)] [调用次数]
+int main(int argc, char *argv[]) {
+    int64_t busy_poll_us = argc > 1 ? std::atoll(argv[1]) : 0;
+    int count = argc > 2 ? std::atoi(argv[2]) : 100000;
+    suprpc::init_logger(false,"",spdlog::level::level_enum::warn);
+    suprpc::client::RpcClient client(false,"127.0.0.1",9090);
+    client.setBusyPoll(busy_poll_us);
+
+    Json::Value params,result;
+    params["data"] = std::string(64,'x');
+    std::vector<int64_t> latencies;
+    latencies.reserve(count);
+    for(int i = 0; i < count; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        if(client.call("Echo",params,result) == false) {
+            SUP_LOG_ERROR("第 {} 次调用失败",i);
+            return 1;
+        }
+        latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(latencies.begin(),latencies.end());
+    auto percentile = [&](double p) {
+        return latencies[std::min(latencies.size() - 1,(size_t)(p * latencies.size()))] / 1000.0;
+    };
+    printf("busy_poll=%ldus count=%d p50=%.1fus p99=%.1fus p999=%.1fus max=%.1fus\n",
+        (long)busy_poll_us,count,percentile(0.5),percentile(0.99),percentile(0.999),
+        latencies.back() / 1000.0);
+    return 0;
+}
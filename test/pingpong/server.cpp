@@ -0,0 +1,26 @@
+#include "../../common/JsonConcrete.hpp"
+#include "../../server/Server.hpp"
+
+// 乒乓测试服务端：原样返回请求中的数据
+// 用法: ./server [忙轮询窗口(微秒)]
+void Echo(const Json::Value&req,Json::Value&rsp) {
+    rsp = req["data"].asString();
+}
+
+int main(int argc, char *argv[]) {
+    int64_t busy_poll_us = argc > 1 ? std::atoll(argv[1]) : 0;
+    suprpc::init_logger(false,"",spdlog::level::level_enum::warn);
+    std::unique_ptr<suprpc::server::SvrDescbFactory> desc_factory(
+        new suprpc::server::SvrDescbFactory()
+    );
+
+    desc_factory->setMethodNmae("Echo");
+    desc_factory->setParamsDesc("data",suprpc::server::VType::STRING);
+    desc_factory->setReturnType(suprpc::server::VType::STRING);
+    desc_factory->setCallback(Echo);
+    suprpc::server::RpcServer server(suprpc::Address("127.0.0.1",9090));
+    server.registerMethod(desc_factory->build());
+    server.setBusyPoll(busy_poll_us);
+    server.start();
+    return 0;
+}
@@ -0,0 +1,59 @@
+#include "../../common/JsonConcrete.hpp"
+#include "../../client/Client.hpp"
+
+// 批量写入测试客户端：同样的记录分别以逐条调用与双向流发送，比较吞吐
+// 用法: ./client [记录数] [记录字节数] [流窗口(帧数)]
+static double seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char *mode, int count, int size, double elapsed) {
+    printf("%-8s records=%d size=%dB elapsed=%.3fs rate=%.0f rec/s %.1f MB/s\n",
+        mode,count,size,elapsed,count / elapsed,(double)count * size / elapsed / (1 << 20));
+}
+
+int main(int argc, char *argv[]) {
+    int count = argc > 1 ? std::atoi(argv[1]) : 100000;
+    int size = argc > 2 ? std::atoi(argv[2]) : 256;
+    int window = argc > 3 ? std::atoi(argv[3]) : suprpc::default_stream_window;
+    suprpc::init_logger(false,"",spdlog::level::level_enum::warn);
+    suprpc::client::RpcClient client(false,"127.0.0.1",9090);
+    std::string record(size,'x');
+
+    // 逐条调用：每条记录一次请求与一次响应
+    Json::Value params,result;
+    params["record"] = record;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < count; ++i) {
+        if(client.call("Ingest",params,result) == false) {
+            SUP_LOG_ERROR("第 {} 次调用失败",i);
+            return 1;
+        }
+    }
+    report("per-call",count,size,seconds(start));
+
+    // 双向流：全部记录在一个流中发送，按服务端的窗口流控
+    suprpc::client::CallOptions opts;
+    opts.stream_window = window;
+    suprpc::StreamChannel::ptr channel;
+    start = std::chrono::steady_clock::now();
+    if(client.open("IngestStream",Json::Value(Json::objectValue),channel,opts) == false) {
+        SUP_LOG_ERROR("打开双向流失败");
+        return 1;
+    }
+    Json::Value data(record);
+    for(int i = 0; i < count; ++i) {
+        if(channel->write(data) == false) {
+            SUP_LOG_ERROR("第 {} 条记录写入失败: {}",i,suprpc::errReason(channel->rcode()));
+            return 1;
+        }
+    }
+    channel->close();
+    Json::Value summary;
+    if(channel->read(summary) == false || summary["count"].asInt() != count) {
+        SUP_LOG_ERROR("服务端确认的记录数不符");
+        return 1;
+    }
+    report("stream",count,size,seconds(start));
+    return 0;
+}
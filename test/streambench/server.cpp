@@ -0,0 +1,49 @@
+#include "../../common/JsonConcrete.hpp"
+#include "../../server/Server.hpp"
+
+// 批量写入测试服务端：Ingest逐条接收记录，IngestStream在一个双向流中接收全部记录
+// 用法: ./server [工作线程数]
+void Ingest(const Json::Value&req,Json::Value&rsp) {
+    rsp = (int)req["record"].asString().size();
+}
+
+// 读完客户端发来的全部记录后回写统计并结束；流的读写会阻塞，在工作线程中执行
+void IngestStream(const Json::Value&req,const suprpc::StreamChannel::ptr &channel) {
+    Json::Value record;
+    int64_t count = 0, bytes = 0;
+    while(channel->read(record)) {
+        ++count;
+        bytes += record.asString().size();
+    }
+    Json::Value summary;
+    summary["count"] = (Json::Int64)count;
+    summary["bytes"] = (Json::Int64)bytes;
+    channel->write(summary);
+    channel->close();
+}
+
+int main(int argc, char *argv[]) {
+    int workers = argc > 1 ? std::atoi(argv[1]) : 4;
+    suprpc::init_logger(false,"",spdlog::level::level_enum::warn);
+    std::unique_ptr<suprpc::server::SvrDescbFactory> desc_factory(
+        new suprpc::server::SvrDescbFactory()
+    );
+    desc_factory->setMethodNmae("Ingest");
+    desc_factory->setParamsDesc("record",suprpc::server::VType::STRING);
+    desc_factory->setReturnType(suprpc::server::VType::INTEGRAL);
+    desc_factory->setCallback(Ingest);
+    auto ingest = desc_factory->build();
+
+    desc_factory.reset(new suprpc::server::SvrDescbFactory());
+    desc_factory->setMethodNmae("IngestStream");
+    desc_factory->setReturnType(suprpc::server::VType::OBJECT);
+    desc_factory->setBidiCallback(IngestStream);
+    auto ingest_stream = desc_factory->build();
+
+    suprpc::server::RpcServer server(suprpc::Address("127.0.0.1",9090));
+    server.registerMethod(ingest);
+    server.registerMethod(ingest_stream);
+    server.setWorkerThreads(workers);
+    server.start();
+    return 0;
+}
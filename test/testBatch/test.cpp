@@ -0,0 +1,164 @@
+/**
+ * @file test.cpp
+ * @brief 批量帧：编解码往返、按调用顺序的逐个应答、格式错误的调用只影响自身、按批量id取消
+ */
+#include "../../server/RpcRouter.hpp"
+#include "../common/FakeConn.hpp"
+#include <cassert>
+#include <future>
+#include <thread>
+
+using namespace suprpc;
+using namespace suprpc::server;
+using namespace suprpc::test;
+
+static RpcBatchRequest::ptr parse(const std::string &body)
+{
+    auto batch = MessageFactory::create<RpcBatchRequest>();
+    assert(batch->deserialize(body));
+    batch->setId("batch");
+    batch->setMType(MType::REQ_RPC_BATCH);
+    return batch;
+}
+
+int main()
+{
+    init_logger(false, "", spdlog::level::level_enum::critical);
+
+    // 编解码往返后调用的顺序与内容不变
+    {
+        auto batch = MessageFactory::create<RpcBatchRequest>();
+        Json::Value params;
+        for (int i = 0; i < 3; ++i)
+        {
+            params["num1"] = i;
+            params["num2"] = 1;
+            batch->addCall("Add", params);
+        }
+        batch->setTimeout(500);
+        auto decoded = parse(batch->serialize());
+        assert(decoded->check() && decoded->size() == 3 && decoded->timeout() == 500);
+        for (size_t i = 0; i < decoded->size(); ++i)
+        {
+            assert(decoded->callValid(i));
+            assert(decoded->callMethod(i) == "Add");
+            assert(decoded->callParams(i)["num1"].asInt() == (int)i);
+        }
+    }
+
+    RpcRouter router;
+    SvrDescbFactory factory;
+    factory.setMethodNmae("Add");
+    factory.setParamsDesc("num1", VType::INTEGRAL);
+    factory.setParamsDesc("num2", VType::INTEGRAL);
+    factory.setReturnType(VType::INTEGRAL);
+    factory.setCallback([](const Json::Value &params, Json::Value &result)
+                        { result = params["num1"].asInt() + params["num2"].asInt(); });
+    router.registerMethod(factory.build());
+    router.freeze();
+    auto conn = std::make_shared<FakeConn>();
+    BaseConnection::ptr base = conn;
+
+    // 一个批量请求得到一个批量响应，结果按调用顺序排列
+    {
+        auto batch = parse(R"({"calls":[
+            {"method":"Add","parameters":{"num1":1,"num2":2}},
+            1,
+            {"method":"Add"},
+            {"method":"Sub","parameters":{}},
+            {"method":"Add","parameters":{"num1":10,"num2":20}}]})");
+        router.onRpcBatchRequest(base, batch);
+        assert(conn->sent.size() == 1);
+        auto rsp = std::dynamic_pointer_cast<RpcBatchResponse>(conn->sent.back());
+        assert(rsp && rsp->mtype() == MType::RSP_RPC_BATCH && rsp->rid() == "batch");
+        assert(rsp->rcode() == RCode::RCODE_OK && rsp->size() == 5);
+        assert(rsp->callRCode(0) == RCode::RCODE_OK && rsp->callResult(0).asInt() == 3);
+        assert(rsp->callRCode(1) == RCode::RCODE_INVALID_MSG);
+        assert(rsp->callRCode(2) == RCode::RCODE_INVALID_MSG);
+        assert(rsp->callRCode(3) == RCode::RCODE_NOT_FOUND_SERVICE);
+        assert(rsp->callRCode(4) == RCode::RCODE_OK && rsp->callResult(4).asInt() == 30);
+
+        // 响应同样经过编解码
+        auto decoded = MessageFactory::create<RpcBatchResponse>();
+        assert(decoded->deserialize(rsp->serialize()) && decoded->check());
+        assert(decoded->size() == 5 && decoded->callResult(4).asInt() == 30);
+    }
+
+    // 整个批量格式错误时以一个RCODE_INVALID_MSG的批量响应结束
+    const char *bad[] = {
+        R"({"calls":"x"})",
+        R"({"calls":[]})",
+        R"({"calls":[{"method":"Add","parameters":{}}],"timeout":"x"})",
+    };
+    for (auto body : bad)
+    {
+        conn->sent.clear();
+        auto batch = parse(body);
+        router.onRpcBatchRequest(base, batch);
+        assert(conn->sent.size() == 1);
+        auto rsp = std::dynamic_pointer_cast<RpcBatchResponse>(conn->sent.back());
+        assert(rsp && rsp->rcode() == RCode::RCODE_INVALID_MSG && rsp->size() == 0);
+    }
+
+    // 客户端读取格式错误的响应时得到解析失败，而不是抛异常
+    {
+        auto rsp = MessageFactory::create<RpcBatchResponse>();
+        assert(rsp->deserialize(R"({"rcode":0,"results":[1,{"rcode":"x"},{"rcode":0,"result":5}]})"));
+        assert(rsp->size() == 3);
+        assert(rsp->callRCode(0) == RCode::RCODE_PARSE_FAILED);
+        assert(rsp->callRCode(1) == RCode::RCODE_PARSE_FAILED);
+        assert(rsp->callRCode(2) == RCode::RCODE_OK && rsp->callResult(2).asInt() == 5);
+        assert(rsp->callRCode(9) == RCode::RCODE_PARSE_FAILED && rsp->callResult(9).isNull());
+    }
+
+    // 以批量id取消时，仍在排队的调用一并取消，也不再发送批量响应
+    {
+        std::atomic<int> calls(0);
+        std::promise<void> started, open;
+        std::shared_future<void> gate = open.get_future().share();
+        RpcRouter pooled;
+        pooled.setWorkerThreads(1);
+        SvrDescbFactory block;
+        block.setMethodNmae("Block");
+        block.setReturnType(VType::INTEGRAL);
+        block.setCallback([&started, &gate](const Json::Value &, Json::Value &result)
+                          {
+                              started.set_value();
+                              gate.wait();
+                              result = 0; });
+        pooled.registerMethod(block.build());
+        SvrDescbFactory add;
+        add.setMethodNmae("Add");
+        add.setReturnType(VType::INTEGRAL);
+        add.setCallback([&calls](const Json::Value &, Json::Value &result)
+                        { result = ++calls; });
+        pooled.registerMethod(add.build());
+        pooled.freeze();
+
+        auto blocker = std::make_shared<FakeConn>();
+        auto req = MessageFactory::create<RpcRequest>();
+        req->setId("block");
+        req->setMType(MType::REQ_RPC);
+        req->setMethod("Block");
+        req->setParams(Json::Value(Json::objectValue));
+        BaseConnection::ptr blocker_base = blocker;
+        pooled.onRpcRequest(blocker_base, req);
+        started.get_future().wait();
+
+        conn->clear();
+        auto batch = parse(R"({"calls":[{"method":"Add","parameters":{}},{"method":"Add","parameters":{}}]})");
+        pooled.onRpcBatchRequest(base, batch);
+        auto cancel = MessageFactory::create<CancelRequest>();
+        cancel->setId("batch");
+        cancel->setMType(MType::REQ_CANCEL);
+        pooled.onCancelRequest(base, cancel);
+        open.set_value();
+        for (int i = 0; i < 1000 && pooled.inflight() > 0; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        assert(pooled.inflight() == 0);
+        assert(calls == 0 && conn->count() == 0 && conn->pending() == 0);
+    }
+
+    std::cout << "testBatch passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,122 @@
+/**
+ * @file test.cpp
+ * @brief 请求攒批：攒满立即执行、未攒满时等待窗口后执行、执行器拒绝与停止时的结束码
+ */
+#include "../../server/Batcher.hpp"
+#include <cassert>
+#include <atomic>
+
+using namespace suprpc;
+using namespace suprpc::server;
+
+struct Recorder
+{
+    std::mutex mutex;
+    std::vector<size_t> batches;   // 每批的大小
+    std::vector<RCode> codes;      // 每个请求的结束码
+    std::vector<int> results;
+
+    size_t finished()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        return codes.size();
+    }
+};
+
+static RequestBatcher::ptr makeBatcher(size_t max_batch, int max_delay_us, Recorder &rec)
+{
+    BatchPolicy policy;
+    policy.max_batch = max_batch;
+    policy.max_delay_us = max_delay_us;
+    return std::make_shared<RequestBatcher>(policy, [&rec](std::vector<RequestBatcher::Item> &items)
+                                            {
+                                                {
+                                                    std::unique_lock<std::mutex> lock(rec.mutex);
+                                                    rec.batches.push_back(items.size());
+                                                }
+                                                for (auto &item : items)
+                                                    item.done(item.params["num"].asInt() * 10, RCode::RCODE_OK); });
+}
+
+static RequestBatcher::DoneCallback record(Recorder &rec)
+{
+    return [&rec](const Json::Value &result, RCode code)
+    {
+        std::unique_lock<std::mutex> lock(rec.mutex);
+        rec.codes.push_back(code);
+        rec.results.push_back(result.isInt() ? result.asInt() : -1);
+    };
+}
+
+static Json::Value params(int num)
+{
+    Json::Value val;
+    val["num"] = num;
+    return val;
+}
+
+int main()
+{
+    init_logger(false, "", spdlog::level::level_enum::critical);
+
+    // 攒满max_batch时在提交最后一个请求的线程中立即执行，不等待窗口
+    {
+        Recorder rec;
+        auto batcher = makeBatcher(4, 10 * 1000 * 1000, rec);
+        for (int i = 0; i < 3; ++i)
+            batcher->add(params(i), record(rec));
+        assert(rec.finished() == 0);
+        batcher->add(params(3), record(rec));
+        assert(rec.finished() == 4);
+        assert((rec.batches == std::vector<size_t>{4}));
+        assert((rec.results == std::vector<int>{0, 10, 20, 30}));
+        assert(batcher->stats()["batches"].asUInt64() == 1 && batcher->stats()["calls"].asUInt64() == 4);
+    }
+
+    // 未攒满时，第一个请求等待max_delay_us后整批执行
+    {
+        Recorder rec;
+        auto batcher = makeBatcher(100, 20 * 1000, rec);
+        auto start = RequestBatcher::Clock::now();
+        for (int i = 0; i < 3; ++i)
+            batcher->add(params(i), record(rec));
+        assert(rec.finished() == 0 && batcher->stats()["pending"].asUInt64() == 3);
+        for (int i = 0; i < 1000 && rec.finished() < 3; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        assert(rec.finished() == 3);
+        assert(RequestBatcher::Clock::now() - start >= std::chrono::milliseconds(20));
+        assert((rec.batches == std::vector<size_t>{3}));
+
+        // 窗口从下一批的第一个请求重新计时
+        batcher->add(params(5), record(rec));
+        for (int i = 0; i < 1000 && rec.finished() < 4; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        assert((rec.batches == std::vector<size_t>{3, 1}) && rec.results.back() == 50);
+    }
+
+    // 执行器拒绝整批时，其中每个请求以过载结束
+    {
+        Recorder rec;
+        auto batcher = makeBatcher(2, 10 * 1000 * 1000, rec);
+        batcher->setExecutor([](const std::function<void()> &, const std::function<void()> &fail)
+                             { fail(); });
+        batcher->add(params(1), record(rec));
+        batcher->add(params(2), record(rec));
+        assert(rec.batches.empty());
+        assert((rec.codes == std::vector<RCode>{RCode::RCODE_OVERLOADED, RCode::RCODE_OVERLOADED}));
+    }
+
+    // 停止时尚未执行的请求与之后到达的请求都以内部错误结束
+    {
+        Recorder rec;
+        auto batcher = makeBatcher(100, 10 * 1000 * 1000, rec);
+        batcher->add(params(1), record(rec));
+        batcher->shutdown();
+        batcher->add(params(2), record(rec));
+        assert(rec.batches.empty());
+        assert((rec.codes == std::vector<RCode>{RCode::RCODE_INTERNAL_ERROR, RCode::RCODE_INTERNAL_ERROR}));
+    }
+
+    std::cout << "testBatcher passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,114 @@
+/**
+ * @file test.cpp
+ * @brief 响应缓存：有效期、LRU淘汰、字节上限，以及路由命中缓存时跳过业务回调
+ */
+#include "../../server/RpcRouter.hpp"
+#include "../common/FakeConn.hpp"
+#include <cassert>
+#include <thread>
+
+using namespace suprpc;
+using namespace suprpc::server;
+using namespace suprpc::test;
+
+static CachePolicy policy(int ttl_ms, size_t max_entries, size_t max_bytes)
+{
+    CachePolicy p;
+    p.ttl_ms = ttl_ms;
+    p.max_entries = max_entries;
+    p.max_bytes = max_bytes;
+    return p;
+}
+
+int main()
+{
+    init_logger(false, "", spdlog::level::level_enum::critical);
+
+    // 有效期内命中，过期后按未命中处理并移除
+    {
+        ResponseCache cache(policy(30, 0, 0));
+        std::string body;
+        cache.put("a", "1");
+        assert(cache.get("a", body) && body == "1");
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        assert(cache.get("a", body) == false);
+        assert(cache.stats()["entries"].asUInt64() == 0 && cache.stats()["bytes"].asUInt64() == 0);
+        assert(cache.stats()["hits"].asUInt64() == 1 && cache.stats()["misses"].asUInt64() == 1);
+    }
+
+    // 超出条目数时淘汰最久未使用的，读取会刷新使用顺序
+    {
+        ResponseCache cache(policy(60000, 2, 0));
+        std::string body;
+        cache.put("a", "1");
+        cache.put("b", "2");
+        assert(cache.get("a", body));
+        cache.put("c", "3");
+        assert(cache.get("b", body) == false);
+        assert(cache.get("a", body) && body == "1");
+        assert(cache.get("c", body) && body == "3");
+        assert(cache.stats()["evictions"].asUInt64() == 1);
+
+        // 同一参数再次写入替换旧值，不重复计数
+        cache.put("c", "33");
+        assert(cache.get("c", body) && body == "33");
+        assert(cache.stats()["entries"].asUInt64() == 2);
+        assert(cache.stats()["bytes"].asUInt64() == 2 + 3);
+    }
+
+    // 字节上限按参数与正文合计，超出时从最久未使用的开始淘汰，单条超限的不缓存
+    {
+        ResponseCache cache(policy(60000, 0, 10));
+        std::string body;
+        cache.put("a", "1234"); // 5
+        cache.put("b", "1234"); // 10
+        assert(cache.stats()["bytes"].asUInt64() == 10);
+        cache.put("c", "12");   // 13，淘汰a
+        assert(cache.get("a", body) == false && cache.get("b", body) && cache.get("c", body));
+        assert(cache.stats()["bytes"].asUInt64() == 8);
+        cache.put("d", "1234567890");
+        assert(cache.get("d", body) == false);
+        assert(cache.stats()["entries"].asUInt64() == 2 && cache.stats()["bytes"].asUInt64() == 8);
+    }
+
+    // 路由：相同参数在有效期内只执行一次回调，命中的应答与首次执行的结果相同
+    {
+        int calls = 0;
+        RpcRouter router;
+        SvrDescbFactory factory;
+        factory.setMethodNmae("Square");
+        factory.setParamsDesc("num", VType::INTEGRAL);
+        factory.setReturnType(VType::INTEGRAL);
+        factory.setCachePolicy(policy(60000, 16, 0));
+        factory.setCallback([&calls](const Json::Value &params, Json::Value &result)
+                            {
+                                ++calls;
+                                result = params["num"].asInt() * params["num"].asInt(); });
+        router.registerMethod(factory.build());
+        router.freeze();
+        auto conn = std::make_shared<FakeConn>();
+        BaseConnection::ptr base = conn;
+        auto call = [&router, &base](const std::string &id, int num)
+        {
+            auto req = MessageFactory::create<RpcRequest>();
+            req->setId(id);
+            req->setMType(MType::REQ_RPC);
+            req->setMethod("Square");
+            Json::Value params;
+            params["num"] = num;
+            req->setParams(params);
+            router.onRpcRequest(base, req);
+        };
+        call("first", 6);
+        call("second", 6);
+        call("third", 7);
+        assert(calls == 2 && conn->count() == 3);
+        auto hit = std::dynamic_pointer_cast<RpcResponse>(conn->sent[1]);
+        assert(hit && hit->rid() == "second");
+        hit->materialize();
+        assert(hit->rcode() == RCode::RCODE_OK && hit->result().asInt() == 36);
+    }
+
+    std::cout << "testCache passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,89 @@
+/**
+ * @file test.cpp
+ * @brief 回调形式的调用：成功回调结果，超时与服务端错误以状态码回调失败，且只回调一次
+ */
+#include "../../client/RpcCaller.hpp"
+#include "../common/FakeConn.hpp"
+#include <cassert>
+#include <thread>
+
+using namespace suprpc;
+using namespace suprpc::client;
+using namespace suprpc::test;
+
+struct Outcome
+{
+    std::mutex mutex;
+    int ok = 0;
+    int failed = 0;
+    Json::Value result;
+    RCode code = RCode::RCODE_OK;
+};
+
+// 以rcode应答conn上最近发出的请求
+static void answer(const Requestor::ptr &requestor, const FakeConn::ptr &conn, RCode code, const Json::Value &result)
+{
+    auto rsp = MessageFactory::create<RpcResponse>();
+    rsp->setId(conn->last()->rid());
+    rsp->setMType(MType::RSP_RPC);
+    rsp->setRCode(code);
+    rsp->setResult(result);
+    BaseMessage::ptr msg = rsp;
+    requestor->onResponse(conn, msg);
+}
+
+int main()
+{
+    init_logger(false, "", spdlog::level::level_enum::critical);
+
+    auto requestor = std::make_shared<Requestor>();
+    RpcCaller caller(requestor);
+    auto conn = std::make_shared<FakeConn>();
+    Outcome outcome;
+    auto on_result = [&outcome](const Json::Value &result)
+    {
+        std::unique_lock<std::mutex> lock(outcome.mutex);
+        ++outcome.ok;
+        outcome.result = result;
+    };
+    auto on_error = [&outcome](RCode code)
+    {
+        std::unique_lock<std::mutex> lock(outcome.mutex);
+        ++outcome.failed;
+        outcome.code = code;
+    };
+
+    // 正常应答时回调结果
+    assert(caller.call(conn, "Add", Json::Value(Json::objectValue), on_result, on_error));
+    answer(requestor, conn, RCode::RCODE_OK, Json::Value(3));
+    assert(outcome.ok == 1 && outcome.failed == 0 && outcome.result.asInt() == 3);
+
+    // 服务端返回的错误码原样交给失败回调
+    assert(caller.call(conn, "Add", Json::Value(Json::objectValue), on_result, on_error));
+    answer(requestor, conn, RCode::RCODE_OVERLOADED, Json::Value());
+    assert(outcome.ok == 1 && outcome.failed == 1 && outcome.code == RCode::RCODE_OVERLOADED);
+
+    // 超时未应答时以RCODE_TIMEOUT回调，之后迟到的应答不再回调
+    CallOptions opts;
+    opts.timeout_ms = 30;
+    assert(caller.call(conn, "Add", Json::Value(Json::objectValue), on_result, on_error, opts));
+    for (int i = 0; i < 1000; ++i)
+    {
+        {
+            std::unique_lock<std::mutex> lock(outcome.mutex);
+            if (outcome.failed == 2)
+                break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    {
+        std::unique_lock<std::mutex> lock(outcome.mutex);
+        assert(outcome.failed == 2 && outcome.code == RCode::RCODE_TIMEOUT);
+    }
+    answer(requestor, conn, RCode::RCODE_OK, Json::Value(5));
+    assert(outcome.ok == 1 && outcome.failed == 2);
+    assert(requestor->pendingTimeouts() == 0);
+
+    std::cout << "testCaller passed" << std::endl;
+    return 0;
+}
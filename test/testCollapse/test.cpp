@@ -0,0 +1,146 @@
+/**
+ * @file test.cpp
+ * @brief 合并调用：同参请求只执行一次并分发结果；执行者未执行就结束时由跟随者接替
+ */
+#include "../../server/RpcRouter.hpp"
+#include "../common/FakeConn.hpp"
+#include <cassert>
+#include <future>
+#include <thread>
+
+using namespace suprpc;
+using namespace suprpc::server;
+using namespace suprpc::test;
+
+static void call(RpcRouter &router, const BaseConnection::ptr &conn, const std::string &method,
+                 const std::string &id, int num, int timeout_ms = 0)
+{
+    auto req = MessageFactory::create<RpcRequest>();
+    req->setId(id);
+    req->setMType(MType::REQ_RPC);
+    req->setMethod(method);
+    Json::Value params;
+    params["num"] = num;
+    req->setParams(params);
+    req->setTimeout(timeout_ms);
+    router.onRpcRequest(conn, req);
+}
+
+// 等待conn收到n条消息，最多等待一秒
+static bool waitFor(const FakeConn::ptr &conn, size_t n)
+{
+    for (int i = 0; i < 1000 && conn->count() < n; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return conn->count() >= n;
+}
+
+// 应答先于计数归还发出，等待路由上的请求全部结束
+static bool waitIdle(RpcRouter &router)
+{
+    for (int i = 0; i < 1000 && router.inflight() > 0; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return router.inflight() == 0;
+}
+
+int main()
+{
+    init_logger(false, "", spdlog::level::level_enum::critical);
+
+    std::atomic<int> calls(0);
+    std::promise<void> started;
+    std::shared_future<void> gate;
+    std::promise<void> open;
+    gate = open.get_future().share();
+
+    RpcRouter router;
+    router.setWorkerThreads(1);
+    {
+        SvrDescbFactory factory;
+        factory.setMethodNmae("Square");
+        factory.setParamsDesc("num", VType::INTEGRAL);
+        factory.setReturnType(VType::INTEGRAL);
+        factory.setCollapse(true);
+        factory.setCallback([&calls](const Json::Value &params, Json::Value &result)
+                            {
+                                ++calls;
+                                result = params["num"].asInt() * params["num"].asInt(); });
+        router.registerMethod(factory.build());
+    }
+    {
+        // 占住唯一的工作线程，让后续请求在队列中等待
+        SvrDescbFactory factory;
+        factory.setMethodNmae("Block");
+        factory.setParamsDesc("num", VType::INTEGRAL);
+        factory.setReturnType(VType::INTEGRAL);
+        factory.setCallback([&started, &gate](const Json::Value &, Json::Value &result)
+                            {
+                                started.set_value();
+                                gate.wait();
+                                result = 0; });
+        router.registerMethod(factory.build());
+    }
+    router.freeze();
+
+    auto blocker = std::make_shared<FakeConn>();
+    std::vector<FakeConn::ptr> conns;
+    for (int i = 0; i < 4; ++i)
+        conns.push_back(std::make_shared<FakeConn>());
+
+    // 同参请求在执行者排队期间到达，只执行一次，每个请求以各自的id得到同一结果
+    {
+        call(router, blocker, "Block", "block", 0);
+        started.get_future().wait();
+        call(router, conns[0], "Square", "a", 7);
+        call(router, conns[1], "Square", "b", 7);
+        call(router, conns[2], "Square", "c", 7);
+        call(router, conns[3], "Square", "d", 8);
+        assert(conns[1]->pending() == 1 && conns[1]->count() == 0);
+        open.set_value();
+        for (int i = 0; i < 4; ++i)
+            assert(waitFor(conns[i], 1));
+        assert(calls == 2 && waitIdle(router));
+        const char *ids[] = {"a", "b", "c", "d"};
+        for (int i = 0; i < 4; ++i)
+        {
+            auto rsp = conns[i]->lastAs<RpcResponse>();
+            assert(rsp && rsp->rid() == ids[i] && rsp->rcode() == RCode::RCODE_OK);
+            assert(rsp->result().asInt() == (i < 3 ? 49 : 64));
+            assert(conns[i]->pending() == 0);
+        }
+        assert(waitFor(blocker, 1));
+    }
+
+    // 执行者在队列中超时：已超时的跟随者不再应答，仍有预算的跟随者接替执行并得到结果
+    {
+        calls = 0;
+        started = std::promise<void>();
+        open = std::promise<void>();
+        gate = open.get_future().share();
+        for (auto &conn : conns)
+            conn->clear();
+
+        call(router, blocker, "Block", "block", 0);
+        started.get_future().wait();
+        call(router, conns[0], "Square", "leader", 5, 30);
+        call(router, conns[1], "Square", "patient", 5, 5000);
+        call(router, conns[2], "Square", "hasty", 5, 30);
+        call(router, conns[3], "Square", "unbounded", 5);
+        std::this_thread::sleep_for(std::chrono::milliseconds(60));
+        open.set_value();
+
+        assert(waitFor(conns[1], 1) && waitFor(conns[3], 1));
+        assert(calls == 1);
+        auto patient = conns[1]->lastAs<RpcResponse>();
+        assert(patient && patient->rid() == "patient" && patient->rcode() == RCode::RCODE_OK);
+        assert(patient->result().asInt() == 25);
+        auto unbounded = conns[3]->lastAs<RpcResponse>();
+        assert(unbounded && unbounded->rid() == "unbounded" && unbounded->result().asInt() == 25);
+        assert(conns[0]->count() == 0 && conns[2]->count() == 0);
+        assert(waitIdle(router));
+        for (auto &conn : conns)
+            assert(conn->pending() == 0);
+    }
+
+    std::cout << "testCollapse passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,154 @@
+/**
+ * @file test.cpp
+ * @brief 截止时间优先队列：出队顺序、不限时请求的老化、过载时的有效吞吐与提前淘汰的应答
+ */
+#include "../../server/RpcRouter.hpp"
+#include "../common/FakeConn.hpp"
+#include <cassert>
+#include <thread>
+
+using namespace suprpc;
+using namespace suprpc::server;
+using namespace suprpc::test;
+
+using Clock = RequestTask::Clock;
+
+static RequestTask makeTask(int id, Clock::time_point deadline, std::vector<int> &order)
+{
+    RequestTask task;
+    task.deadline = deadline;
+    task.run = [id, &order]()
+    { order.push_back(id); };
+    task.drop = [id, &order]()
+    { order.push_back(-id); };
+    return task;
+}
+
+// 单个工作线程依次执行队列中的请求，每个耗时cost；返回在各自截止时间前完成的请求数
+static int goodput(const RequestQueue::ptr &queue, int loose, int tight, std::chrono::milliseconds cost)
+{
+    int good = 0;
+    auto start = Clock::now();
+    auto push = [&](int n, std::chrono::milliseconds budget)
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            RequestTask task;
+            task.deadline = start + budget;
+            task.cost_us = std::chrono::duration_cast<std::chrono::microseconds>(cost).count();
+            Clock::time_point deadline = task.deadline;
+            task.run = [&good, deadline, cost]()
+            {
+                std::this_thread::sleep_for(cost);
+                if (Clock::now() <= deadline)
+                    ++good;
+            };
+            assert(queue->push(std::move(task)));
+        }
+    };
+    // 宽松的请求先到，紧急的请求后到
+    push(loose, std::chrono::milliseconds(2000));
+    push(tight, std::chrono::milliseconds(30));
+    queue->close();
+    RequestTask task;
+    while (queue->pop(task))
+        task.run();
+    return good;
+}
+
+int main()
+{
+    init_logger(false, "", spdlog::level::level_enum::critical);
+
+    // 按截止时间出队，已无法按时完成的请求被淘汰
+    {
+        std::vector<int> order;
+        EdfQueue queue(16);
+        auto now = Clock::now();
+        assert(queue.push(makeTask(1, now + std::chrono::seconds(3), order)));
+        assert(queue.push(makeTask(2, now + std::chrono::seconds(1), order)));
+        assert(queue.push(makeTask(3, now + std::chrono::seconds(2), order)));
+        RequestTask hopeless = makeTask(4, now + std::chrono::milliseconds(10), order);
+        hopeless.cost_us = 1000 * 1000;
+        assert(queue.push(std::move(hopeless)));
+        queue.close();
+        RequestTask task;
+        while (queue.pop(task))
+            task.run();
+        assert((order == std::vector<int>{-4, 2, 3, 1}));
+        assert(queue.dropped() == 1);
+    }
+
+    // 不限时的请求按入队时刻加隐含预算排序，不会排在所有限时请求之后
+    {
+        std::vector<int> order;
+        EdfQueue queue(16, 500);
+        auto now = Clock::now();
+        assert(queue.push(makeTask(1, Clock::time_point::max(), order)));
+        assert(queue.push(makeTask(2, now + std::chrono::seconds(5), order)));
+        assert(queue.push(makeTask(3, now + std::chrono::milliseconds(100), order)));
+        assert(queue.push(makeTask(4, Clock::time_point::max(), order)));
+        queue.close();
+        RequestTask task;
+        while (queue.pop(task))
+            task.run();
+        assert((order == std::vector<int>{3, 1, 4, 2}));
+    }
+
+    // 积压时紧急请求排在宽松请求之后会全部超时，截止时间优先让两类请求都按时完成
+    {
+        auto cost = std::chrono::milliseconds(2);
+        int fifo = goodput(std::make_shared<FifoQueue>(64), 20, 10, cost);
+        int edf = goodput(std::make_shared<EdfQueue>(64), 20, 10, cost);
+        assert(edf == 30);
+        assert(fifo <= 20 && edf > fifo);
+    }
+
+    // 路由在出队淘汰时立即以超时应答，不必等调用方自己的超时
+    {
+        RpcRouter router;
+        router.setWorkerThreads(1, QueuePolicy::EDF);
+        SvrDescbFactory factory;
+        factory.setMethodNmae("Slow");
+        factory.setReturnType(VType::INTEGRAL);
+        factory.setCallback([](const Json::Value &, Json::Value &result)
+                            {
+                                std::this_thread::sleep_for(std::chrono::milliseconds(80));
+                                result = 1; });
+        router.registerMethod(factory.build());
+        router.freeze();
+        auto conn = std::make_shared<FakeConn>();
+        auto call = [&router, &conn](const std::string &id, int timeout_ms)
+        {
+            auto req = MessageFactory::create<RpcRequest>();
+            req->setId(id);
+            req->setMType(MType::REQ_RPC);
+            req->setMethod("Slow");
+            req->setParams(Json::Value(Json::objectValue));
+            req->setTimeout(timeout_ms);
+            BaseConnection::ptr base = conn;
+            router.onRpcRequest(base, req);
+        };
+        auto wait = [&conn](size_t n)
+        {
+            for (int i = 0; i < 1000 && conn->count() < n; ++i)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            return conn->count() >= n;
+        };
+
+        // 第一次调用留下约80ms的耗时估计
+        call("warm", 0);
+        assert(wait(1) && conn->lastRCode() == RCode::RCODE_OK);
+
+        auto start = Clock::now();
+        call("late", 40);
+        assert(wait(2));
+        auto rsp = conn->lastAs<RpcResponse>();
+        assert(rsp && rsp->rid() == "late" && rsp->rcode() == RCode::RCODE_TIMEOUT);
+        assert(Clock::now() - start < std::chrono::milliseconds(40));
+        assert(router.metrics()["workers"]["dropped"].asUInt64() == 1);
+    }
+
+    std::cout << "testEdf passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,108 @@
+/**
+ * @file test.cpp
+ * @brief 公平队列的隔离：一个分组灌满队列时，其他分组的请求仍能入队并按轮转出队
+ */
+#include "../../server/Executor.hpp"
+#include <cassert>
+
+using namespace suprpc;
+using namespace suprpc::server;
+
+static RequestTask makeTask(const std::string &flow, int id, std::vector<int> &order, std::vector<int> &rejected)
+{
+    RequestTask task;
+    task.flow = flow;
+    task.tenant = flow;
+    task.cost_us = 1000;
+    task.run = [id, &order]()
+    { order.push_back(id); };
+    task.reject = [id, &rejected]()
+    { rejected.push_back(id); };
+    return task;
+}
+
+int main()
+{
+    init_logger(false, "", spdlog::level::level_enum::critical);
+
+    // 嘈杂分组占满容量后，安静分组的请求挤出嘈杂分组队尾的请求
+    {
+        std::vector<int> order, rejected;
+        FairQueue queue(8, FairWeights());
+        int refused = 0;
+        for (int i = 0; i < 20; ++i)
+        {
+            if (queue.push(makeTask("noisy", 100 + i, order, rejected)) == false)
+                ++refused;
+        }
+        assert(refused == 12 && rejected.empty());
+        for (int i = 0; i < 3; ++i)
+        {
+            assert(queue.push(makeTask("quiet", 200 + i, order, rejected)));
+        }
+        assert(queue.length() == 8);
+        assert(queue.evicted() == 3);
+        assert((rejected == std::vector<int>{107, 106, 105}));
+
+        RequestTask task;
+        while (queue.length() > 0 && queue.pop(task))
+        {
+            task.run();
+        }
+        // 两个分组轮流出队，安静分组不必排在嘈杂分组的全部积压之后
+        assert(order.size() == 8);
+        assert(order[0] == 100 && order[1] == 200 && order[3] == 201 && order[5] == 202);
+    }
+
+    // 挤出只针对积压更多的分组：满队列中各分组相当时新请求被直接拒绝
+    {
+        std::vector<int> order, rejected;
+        FairQueue queue(4, FairWeights());
+        for (int i = 0; i < 2; ++i)
+        {
+            assert(queue.push(makeTask("a", i, order, rejected)));
+            assert(queue.push(makeTask("b", 10 + i, order, rejected)));
+        }
+        assert(queue.push(makeTask("a", 2, order, rejected)) == false);
+        assert(queue.push(makeTask("c", 20, order, rejected)));
+        assert(rejected.size() == 1 && queue.evicted() == 1);
+    }
+
+    // 积压按权重折算：权重高的分组可以多占队列
+    {
+        std::vector<int> order, rejected;
+        FairWeights weights;
+        weights["gold"] = 4;
+        FairQueue queue(6, weights);
+        for (int i = 0; i < 4; ++i)
+            assert(queue.push(makeTask("gold", i, order, rejected)));
+        for (int i = 0; i < 2; ++i)
+            assert(queue.push(makeTask("free", 10 + i, order, rejected)));
+        assert(queue.push(makeTask("gold", 4, order, rejected)));
+        assert((rejected == std::vector<int>{11}));
+    }
+
+    // 嘈杂分组把所有请求都标为高优先级，也只能占加急通道的份额，安静分组的普通请求照常出队
+    {
+        std::vector<int> order, rejected;
+        FairQueue queue(16, FairWeights());
+        for (int i = 0; i < 8; ++i)
+        {
+            RequestTask task = makeTask("noisy", 100 + i, order, rejected);
+            task.priority = Priority::HIGH;
+            assert(queue.push(std::move(task)));
+        }
+        for (int i = 0; i < 2; ++i)
+            assert(queue.push(makeTask("quiet", 200 + i, order, rejected)));
+
+        RequestTask task;
+        while (queue.length() > 0 && queue.pop(task))
+        {
+            task.run();
+        }
+        assert((order == std::vector<int>{100, 101, 102, 103, 200, 104, 105, 106, 107, 201}));
+    }
+
+    std::cout << "testFairQueue passed" << std::endl;
+    return 0;
+}
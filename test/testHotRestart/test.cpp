@@ -0,0 +1,111 @@
+/**
+ * @file test.cpp
+ * @brief 热重启交接：新进程接管旧进程的监听套接字，交接前已在监听队列中的连接不会丢失
+ */
+#include "../../common/HotRestart.hpp"
+#include <arpa/inet.h>
+#include <sys/wait.h>
+#include <cassert>
+
+using namespace suprpc;
+
+static struct sockaddr_in loopback(uint16_t port)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return addr;
+}
+
+// 与muduo的Acceptor一样以SO_REUSEPORT绑定
+static int bindSocket(uint16_t port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+    struct sockaddr_in addr = loopback(port);
+    assert(::bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    return fd;
+}
+
+static int connectTo(uint16_t port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = loopback(port);
+    assert(::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    return fd;
+}
+
+int main()
+{
+    init_logger(false, "", spdlog::level::level_enum::critical);
+    std::string path = "/tmp/suprpc_test_" + std::to_string(getpid()) + ".sock";
+    uint16_t port = 20000 + getpid() % 20000;
+    int ready[2];
+    assert(::pipe(ready) == 0);
+
+    pid_t old = ::fork();
+    if (old == 0)
+    {
+        // 旧进程：监听并等待交接，交出后把监听套接字从epoll中摘除
+        int listener = bindSocket(port);
+        ::listen(listener, 16);
+        int epfd = ::epoll_create1(0);
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = listener;
+        ::epoll_ctl(epfd, EPOLL_CTL_ADD, listener, &ev);
+        std::atomic<bool> done(false);
+        bool detached = false;
+        HotRestart::instance().serve(path, port, [&]()
+                                     {
+                                         HotRestart::detachListener(listener);
+                                         detached = ::epoll_ctl(epfd, EPOLL_CTL_DEL, listener, nullptr) < 0 && errno == ENOENT;
+                                         done = true; });
+        char c = 'r';
+        assert(::write(ready[1], &c, 1) == 1);
+        while (done == false)
+        {
+            ::usleep(1000);
+        }
+        ::_exit(detached ? 0 : 1);
+    }
+
+    char c = 0;
+    assert(::read(ready[0], &c, 1) == 1);
+    // 交接路径只允许属主访问
+    struct stat st;
+    assert(::stat(path.c_str(), &st) == 0 && (st.st_mode & 0777) == 0600);
+
+    // 交接之前连上旧进程，连接停在监听队列中
+    int queued = connectTo(port);
+
+    // 新进程：找出自己新建的套接字，继承后替换，再listen
+    int other = bindSocket(port); // 其他分片先建好的套接字
+    std::vector<int> before = HotRestart::openFds();
+    int mine = bindSocket(port);
+    assert(HotRestart::createdSocket(before, port) == mine);
+    assert(HotRestart::instance().inherit(path) == 1);
+    assert(HotRestart::instance().adopt(mine));
+    assert(HotRestart::instance().adopt(other) == false); // 继承的套接字已用完
+    assert(::listen(mine, 16) == 0);
+
+    int status = 0;
+    assert(::waitpid(old, &status, 0) == old && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    int accepted = ::accept(mine, nullptr, nullptr);
+    assert(accepted >= 0);
+    int fresh = connectTo(port);
+    int accepted_fresh = ::accept(mine, nullptr, nullptr);
+    assert(accepted_fresh >= 0);
+
+    // 没有旧进程时正常启动
+    assert(HotRestart::instance().inherit(path + ".none") == 0);
+
+    for (int fd : {queued, other, mine, accepted, fresh, accepted_fresh})
+        ::close(fd);
+    ::unlink(path.c_str());
+    std::cout << "testHotRestart passed" << std::endl;
+    return 0;
+}
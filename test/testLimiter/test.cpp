@@ -0,0 +1,115 @@
+/**
+ * @file test.cpp
+ * @brief 并发限制的名额计数：拒绝、取消与流式调用都归还名额，且不影响时延样本
+ */
+#include "../../server/RpcRouter.hpp"
+#include "../common/FakeConn.hpp"
+#include <cassert>
+
+using namespace suprpc;
+using namespace suprpc::server;
+using namespace suprpc::test;
+
+static void call(RpcRouter &router, const BaseConnection::ptr &conn, const std::string &method, const std::string &id)
+{
+    auto req = MessageFactory::create<RpcRequest>();
+    req->setId(id);
+    req->setMType(MType::REQ_RPC);
+    req->setMethod(method);
+    req->setParams(Json::Value(Json::objectValue));
+    router.onRpcRequest(conn, req);
+}
+
+int main()
+{
+    init_logger(false, "", spdlog::level::level_enum::critical);
+
+    // 限制器本身：超过限制的请求被拒绝，cancel归还名额但不调整限制
+    {
+        ConcurrencyLimiter limiter(2, 8);
+        assert(limiter.tryAcquire() && limiter.tryAcquire());
+        assert(limiter.tryAcquire() == false);
+        assert(limiter.inflight() == 2 && limiter.stats()["rejected"].asUInt64() == 1);
+        limiter.cancel();
+        assert(limiter.inflight() == 1 && limiter.limit() == 2);
+        assert(limiter.stats()["rtt_noload_us"].asInt64() == 0);
+
+        // 失败视为过载信号，限制乘性减小但不低于下限
+        limiter.release(100, false);
+        assert(limiter.inflight() == 0 && limiter.limit() == 1);
+
+        // 时延正常且并发接近限制时加性增大
+        assert(limiter.tryAcquire());
+        limiter.release(100, true);
+        assert(limiter.limit() == 2 && limiter.stats()["rtt_noload_us"].asInt64() == 100);
+
+        // 时延超过无负载时延的tolerance倍时减小，每次乘以0.9
+        for (int i = 0; i < 4; ++i)
+        {
+            assert(limiter.tryAcquire());
+            limiter.release(1000, true);
+        }
+        assert(limiter.limit() == 1 && limiter.stats()["rtt_noload_us"].asInt64() == 100);
+    }
+
+    RpcRouter router;
+    router.setConcurrencyLimit(8); // 初始限制为2
+    std::vector<Responder::ptr> held;
+    std::vector<StreamWriter::ptr> streams;
+    {
+        SvrDescbFactory factory;
+        factory.setMethodNmae("Hold");
+        factory.setReturnType(VType::INTEGRAL);
+        factory.setAsyncCallback([&held](const Json::Value &, const Responder::ptr &responder)
+                                 { held.push_back(responder); });
+        router.registerMethod(factory.build());
+    }
+    {
+        SvrDescbFactory factory;
+        factory.setMethodNmae("Watch");
+        factory.setReturnType(VType::INTEGRAL);
+        factory.setStreamCallback([&streams](const Json::Value &, const StreamWriter::ptr &writer)
+                                  { streams.push_back(writer); });
+        router.registerMethod(factory.build());
+    }
+    router.freeze();
+    auto conn = std::make_shared<FakeConn>();
+    BaseConnection::ptr base = conn;
+    auto limiter = [&router]()
+    { return router.metrics()["limiter"]; };
+
+    // 流式调用开始后立即归还名额，长时间打开的流不占用限制
+    for (int i = 0; i < 4; ++i)
+        call(router, base, "Watch", "watch" + std::to_string(i));
+    assert(streams.size() == 4);
+    assert(limiter()["inflight"].asUInt64() == 0 && limiter()["rejected"].asUInt64() == 0);
+
+    // 普通调用占用名额直到应答，超出限制的以过载拒绝
+    call(router, base, "Hold", "hold0");
+    call(router, base, "Hold", "hold1");
+    assert(held.size() == 2 && limiter()["inflight"].asUInt64() == 2);
+    call(router, base, "Hold", "hold2");
+    assert(held.size() == 2 && conn->lastRCode() == RCode::RCODE_OVERLOADED);
+    assert(limiter()["inflight"].asUInt64() == 2 && limiter()["rejected"].asUInt64() == 1);
+
+    // 格式错误的请求在占用名额之前就被拒绝
+    auto bad = MessageFactory::create<RpcRequest>();
+    assert(bad->deserialize(R"({"method":"Hold","parameters":{},"timeout":"x"})"));
+    bad->setId("bad");
+    bad->setMType(MType::REQ_RPC);
+    router.onRpcRequest(base, bad);
+    assert(conn->lastRCode() == RCode::RCODE_INVALID_MSG && limiter()["inflight"].asUInt64() == 2);
+
+    for (auto &responder : held)
+        responder->complete(1);
+    assert(limiter()["inflight"].asUInt64() == 0);
+
+    // 流结束时不再归还名额，也不作为时延样本
+    for (auto &writer : streams)
+        writer->close();
+    streams.clear();
+    assert(limiter()["inflight"].asUInt64() == 0);
+
+    std::cout << "testLimiter passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,85 @@
+/**
+ * @file test.cpp
+ * @brief 请求字段类型错误时的校验：反序列化、check与路由的应答
+ */
+#include "../../server/RpcRouter.hpp"
+#include "../common/FakeConn.hpp"
+#include <cassert>
+
+using namespace suprpc;
+using namespace suprpc::server;
+using namespace suprpc::test;
+
+// 记录路由发出的最后一个应答
+static RpcRequest::ptr parse(const std::string &body)
+{
+    auto req = MessageFactory::create<RpcRequest>();
+    assert(req->deserialize(body));
+    return req;
+}
+
+int main()
+{
+    init_logger(false, "", spdlog::level::level_enum::critical);
+
+    // 消息体必须是对象
+    assert(MessageFactory::create<RpcRequest>()->deserialize("[1]") == false);
+    assert(MessageFactory::create<RpcRequest>()->deserialize("\"Add\"") == false);
+    // 没有字段的消息正文为null，仍能解析
+    auto cancel = MessageFactory::create<CancelRequest>();
+    assert(MessageFactory::create<CancelRequest>()->deserialize(cancel->serialize()));
+
+    // 类型错误的可选字段让check失败，访问器返回默认值而不是抛异常
+    const char *bad[] = {
+        R"({"method":7,"parameters":{}})",
+        R"({"method":"Add","parameters":[]})",
+        R"({"method":"Add","parameters":{},"timeout":"x"})",
+        R"({"method":"Add","parameters":{},"timeout":3000000000})",
+        R"({"method":"Add","parameters":{},"tenant":1})",
+        R"({"method":"Add","parameters":{},"oneway":"x"})",
+        R"({"method":"Add","parameters":{},"window":1.5})",
+    };
+    for (auto body : bad)
+    {
+        auto req = parse(body);
+        assert(req->check() == false);
+        req->method();
+        assert(req->timeout() == 0);
+        assert(req->tenant().empty());
+        assert(req->oneway() == false);
+        assert(req->window() == 0);
+    }
+    assert(parse(R"({"method":"Add","parameters":{},"timeout":100,"tenant":"t"})")->check());
+
+    // 路由先校验请求，格式错误的请求以RCODE_INVALID_MSG应答且不会执行
+    int calls = 0;
+    RpcRouter router;
+    SvrDescbFactory factory;
+    factory.setMethodNmae("Add");
+    factory.setReturnType(VType::INTEGRAL);
+    factory.setCallback([&calls](const Json::Value &, Json::Value &result)
+                        { ++calls; result = 1; });
+    router.registerMethod(factory.build());
+    router.freeze();
+    auto conn = std::make_shared<FakeConn>();
+    BaseConnection::ptr base = conn;
+    for (auto body : bad)
+    {
+        auto req = parse(body);
+        req->setId("bad");
+        req->setMType(MType::REQ_RPC);
+        router.onRpcRequest(base, req);
+        auto rsp = std::dynamic_pointer_cast<RpcResponse>(conn->last());
+        assert(rsp && rsp->rcode() == RCode::RCODE_INVALID_MSG);
+    }
+    assert(calls == 0);
+    auto req = parse(R"({"method":"Add","parameters":{}})");
+    req->setId("good");
+    req->setMType(MType::REQ_RPC);
+    router.onRpcRequest(base, req);
+    auto rsp = std::dynamic_pointer_cast<RpcResponse>(conn->last());
+    assert(rsp && rsp->rcode() == RCode::RCODE_OK && calls == 1);
+
+    std::cout << "testMessage passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,85 @@
+/**
+ * @file test.cpp
+ * @brief 单向调用：客户端不登记请求，服务端执行后无论成败都不发送响应
+ */
+#include "../../server/RpcRouter.hpp"
+#include "../../client/RpcCaller.hpp"
+#include "../common/FakeConn.hpp"
+#include <cassert>
+
+using namespace suprpc;
+using namespace suprpc::server;
+using namespace suprpc::client;
+using namespace suprpc::test;
+
+int main()
+{
+    init_logger(false, "", spdlog::level::level_enum::critical);
+
+    // 客户端：请求带单向标记，经过编解码后保留，不进入请求器
+    auto requestor = std::make_shared<Requestor>();
+    RpcCaller caller(requestor);
+    auto wire = std::make_shared<FakeConn>();
+    CallOptions opts;
+    opts.timeout_ms = 1000;
+    Json::Value params;
+    params["num1"] = 1;
+    params["num2"] = 2;
+    assert(caller.notify(wire, "Add", params, opts));
+    assert(wire->count() == 1 && requestor->pendingTimeouts() == 0);
+    auto sent = wire->lastAs<RpcRequest>();
+    assert(sent && sent->oneway() && sent->timeout() == 1000);
+    auto decoded = MessageFactory::create<RpcRequest>();
+    assert(decoded->deserialize(sent->serialize()) && decoded->oneway());
+
+    // 服务端：执行成功、参数错误、方法不存在、异步完成都不应答
+    int calls = 0;
+    Responder::ptr held;
+    RpcRouter router;
+    {
+        SvrDescbFactory factory;
+        factory.setMethodNmae("Add");
+        factory.setParamsDesc("num1", VType::INTEGRAL);
+        factory.setParamsDesc("num2", VType::INTEGRAL);
+        factory.setReturnType(VType::INTEGRAL);
+        factory.setCallback([&calls](const Json::Value &params, Json::Value &result)
+                            {
+                                ++calls;
+                                result = params["num1"].asInt() + params["num2"].asInt(); });
+        router.registerMethod(factory.build());
+    }
+    {
+        SvrDescbFactory factory;
+        factory.setMethodNmae("Later");
+        factory.setReturnType(VType::INTEGRAL);
+        factory.setAsyncCallback([&held](const Json::Value &, const Responder::ptr &responder)
+                                 { held = responder; });
+        router.registerMethod(factory.build());
+    }
+    router.freeze();
+    auto conn = std::make_shared<FakeConn>();
+    BaseConnection::ptr base = conn;
+    auto notify = [&router, &base](const std::string &method, const Json::Value &params)
+    {
+        auto req = MessageFactory::create<RpcRequest>();
+        req->setId("oneway");
+        req->setMType(MType::REQ_RPC);
+        req->setMethod(method);
+        req->setParams(params);
+        req->setOneway(true);
+        router.onRpcRequest(base, req);
+    };
+
+    notify("Add", params);
+    assert(calls == 1);
+    notify("Add", Json::Value(Json::objectValue));
+    notify("Missing", params);
+    notify("Later", Json::Value(Json::objectValue));
+    assert(held);
+    held->complete(Json::Value(1));
+    assert(calls == 1 && conn->count() == 0);
+    assert(router.inflight() == 0 && conn->pending() == 0);
+
+    std::cout << "testOneway passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,117 @@
+/**
+ * @file test.cpp
+ * @brief 隔离线程池：慢方法占满自己的线程与队列时，其他方法照常执行，过载只拒绝慢方法
+ */
+#include "../../server/RpcRouter.hpp"
+#include "../common/FakeConn.hpp"
+#include <cassert>
+#include <future>
+#include <thread>
+
+using namespace suprpc;
+using namespace suprpc::server;
+using namespace suprpc::test;
+
+static void call(RpcRouter &router, const FakeConn::ptr &conn, const std::string &method, const std::string &id)
+{
+    auto req = MessageFactory::create<RpcRequest>();
+    req->setId(id);
+    req->setMType(MType::REQ_RPC);
+    req->setMethod(method);
+    req->setParams(Json::Value(Json::objectValue));
+    BaseConnection::ptr base = conn;
+    router.onRpcRequest(base, req);
+}
+
+static bool waitFor(const FakeConn::ptr &conn, size_t n)
+{
+    for (int i = 0; i < 1000 && conn->count() < n; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return conn->count() >= n;
+}
+
+int main()
+{
+    init_logger(false, "", spdlog::level::level_enum::critical);
+
+    std::promise<void> started, open;
+    std::shared_future<void> gate = open.get_future().share();
+    std::atomic<bool> first(true);
+    std::atomic<int> slow_calls(0);
+
+    RpcRouter router;
+    router.setWorkerThreads(1);
+    router.addPool("slow", 1, QueuePolicy::FIFO, 1);
+    {
+        SvrDescbFactory factory;
+        factory.setMethodNmae("Slow");
+        factory.setReturnType(VType::INTEGRAL);
+        factory.setPool("slow");
+        factory.setCallback([&](const Json::Value &, Json::Value &result)
+                            {
+                                if (first.exchange(false))
+                                    started.set_value();
+                                gate.wait();
+                                result = ++slow_calls; });
+        router.registerMethod(factory.build());
+    }
+    {
+        SvrDescbFactory factory;
+        factory.setMethodNmae("Fast");
+        factory.setReturnType(VType::INTEGRAL);
+        factory.setCallback([](const Json::Value &, Json::Value &result)
+                            { result = 1; });
+        router.registerMethod(factory.build());
+    }
+    {
+        // 指定了不存在的线程池，退回默认工作线程池
+        SvrDescbFactory factory;
+        factory.setMethodNmae("Stray");
+        factory.setReturnType(VType::INTEGRAL);
+        factory.setPool("missing");
+        factory.setCallback([](const Json::Value &, Json::Value &result)
+                            { result = 2; });
+        router.registerMethod(factory.build());
+    }
+    router.freeze();
+
+    auto slow = std::make_shared<FakeConn>();
+    auto fast = std::make_shared<FakeConn>();
+
+    // 慢方法占住自己的线程，再排一个占满队列，第三个被拒绝
+    call(router, slow, "Slow", "s0");
+    started.get_future().wait();
+    call(router, slow, "Slow", "s1");
+    call(router, slow, "Slow", "s2");
+    assert(slow->count() == 1 && slow->lastRCode() == RCode::RCODE_OVERLOADED);
+    assert(slow->lastAs<RpcResponse>()->rid() == "s2");
+
+    // 默认线程池不受影响
+    for (int i = 0; i < 5; ++i)
+        call(router, fast, i % 2 ? "Stray" : "Fast", "f" + std::to_string(i));
+    assert(waitFor(fast, 5));
+    for (auto &msg : fast->sent)
+        assert(std::dynamic_pointer_cast<RpcResponse>(msg)->rcode() == RCode::RCODE_OK);
+
+    Json::Value metrics = router.metrics();
+    assert(metrics["pools"]["slow"]["rejected"].asUInt64() == 1);
+    assert(metrics["pools"]["slow"]["queued"].asUInt64() == 1);
+    assert(metrics["workers"]["rejected"].asUInt64() == 0);
+
+    open.set_value();
+    assert(waitFor(slow, 3));
+    assert(slow_calls == 2);
+    // 执行计数在应答发出之后才增加
+    auto executed = [&router]()
+    {
+        Json::Value metrics = router.metrics();
+        return metrics["pools"]["slow"]["executed"].asUInt64() == 2 &&
+               metrics["workers"]["executed"].asUInt64() == 5;
+    };
+    for (int i = 0; i < 1000 && executed() == false; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    assert(executed());
+
+    std::cout << "testPool passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,74 @@
+/**
+ * @file test.cpp
+ * @brief 路由表：冻结后重建为完美哈希，运行时注册与注销后重新构建，持有的快照不受影响
+ */
+#include "../../server/RpcRouter.hpp"
+#include <cassert>
+
+using namespace suprpc;
+using namespace suprpc::server;
+
+static ServiceDescribe::ptr makeService(const std::string &method)
+{
+    SvrDescbFactory factory;
+    factory.setMethodNmae(method);
+    factory.setReturnType(VType::INTEGRAL);
+    factory.setCallback([](const Json::Value &, Json::Value &result)
+                        { result = 0; });
+    return factory.build();
+}
+
+static std::string name(int i)
+{
+    return "Method" + std::to_string(i);
+}
+
+int main()
+{
+    init_logger(false, "", spdlog::level::level_enum::critical);
+
+    const int n = 200;
+    ServiceManager manager;
+    for (int i = 0; i < n; ++i)
+        manager.insert(makeService(name(i)));
+    assert(manager.snapshot()->perfect() == false);
+
+    manager.freeze();
+    auto frozen = manager.snapshot();
+    assert(frozen->perfect());
+    for (int i = 0; i < n; ++i)
+        assert(frozen->find(name(i)) && frozen->find(name(i))->method() == name(i));
+    // 不存在的方法即使落在已占用的槽上也要比对名字
+    for (int i = n; i < 2 * n; ++i)
+        assert(frozen->find(name(i)).get() == nullptr);
+    assert(frozen->find("").get() == nullptr);
+
+    // 冻结后注册：新快照重新构建完美哈希，旧快照保持原样
+    manager.insert(makeService("Late"));
+    auto grown = manager.snapshot();
+    assert(grown != frozen && grown->perfect());
+    assert(grown->find("Late") && frozen->find("Late").get() == nullptr);
+    for (int i = 0; i < n; ++i)
+        assert(grown->find(name(i))->method() == name(i));
+
+    // 注销：新快照中找不到，其余方法不受影响；持有的旧快照中的引用依旧有效
+    const ServiceDescribe::ptr &held = grown->find(name(7));
+    manager.remove(name(7));
+    auto shrunk = manager.snapshot();
+    assert(shrunk->perfect() && shrunk->services().size() == (size_t)n);
+    assert(shrunk->find(name(7)).get() == nullptr && manager.select(name(7)).get() == nullptr);
+    assert(shrunk->find("Late") && shrunk->find(name(8))->method() == name(8));
+    assert(held && held->method() == name(7));
+
+    // 同一线程交替查找两个管理器，各自得到自己的服务
+    ServiceManager other;
+    other.insert(makeService(name(7)));
+    other.freeze();
+    auto mine = manager.snapshot();
+    auto theirs = other.select(name(7));
+    assert(theirs && mine->find(name(7)).get() == nullptr && manager.select(name(7)).get() == nullptr);
+    assert(other.select(name(7)) == theirs);
+
+    std::cout << "testRoute passed" << std::endl;
+    return 0;
+}
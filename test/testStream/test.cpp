@@ -0,0 +1,127 @@
+/**
+ * @file test.cpp
+ * @brief 双向流的信用流控：信用耗尽时停止发送、按半窗口归还信用、违反流控时结束整个流
+ */
+#include "../../common/Stream.hpp"
+#include <cassert>
+#include <future>
+#include <thread>
+
+using namespace suprpc;
+
+// 一端发出的帧先排在这里，由测试交给另一端，模拟一个方向的连接
+struct Wire : public BaseConnection
+{
+    std::mutex mutex;
+    std::deque<StreamFrame::ptr> frames;
+    void send(const BaseMessage::ptr &msg) override
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        frames.push_back(std::dynamic_pointer_cast<StreamFrame>(msg));
+    }
+    void shutdown() override {}
+    bool connected() override { return true; }
+    bool congested() override { return false; }
+
+    size_t deliver(const StreamChannel::ptr &peer)
+    {
+        std::deque<StreamFrame::ptr> pending;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            pending.swap(frames);
+        }
+        for (auto &frame : pending)
+        {
+            peer->onFrame(frame);
+        }
+        return pending.size();
+    }
+
+    StreamFrame::ptr last()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        return frames.empty() ? StreamFrame::ptr() : frames.back();
+    }
+};
+
+static StreamFrame::ptr frame(const std::string &body)
+{
+    auto f = MessageFactory::create<StreamFrame>();
+    assert(f->deserialize(body));
+    return f;
+}
+
+int main()
+{
+    init_logger(false, "", spdlog::level::level_enum::critical);
+
+    // 发送方的信用等于接收方的窗口，接收方每取走半个窗口归还一次信用
+    {
+        auto to_reader = std::make_shared<Wire>(), to_writer = std::make_shared<Wire>();
+        auto writer = std::make_shared<StreamChannel>(to_reader, "s", 4, 4);
+        auto reader = std::make_shared<StreamChannel>(to_writer, "s", 4, 4);
+        for (int i = 0; i < 4; ++i)
+            assert(writer->tryWrite(i));
+        assert(writer->tryWrite(4) == false && writer->credit() == 0);
+        assert(to_reader->deliver(reader) == 4);
+
+        Json::Value data;
+        assert(reader->read(data) && data.asInt() == 0);
+        assert(to_writer->deliver(writer) == 0);
+        assert(reader->read(data) && data.asInt() == 1);
+        assert(to_writer->deliver(writer) == 1);
+        assert(writer->credit() == 2);
+
+        // 信用耗尽时write阻塞，收到归还的信用后继续
+        assert(writer->tryWrite(5) && writer->tryWrite(6));
+        std::promise<bool> written;
+        std::thread blocked([&]()
+                            { written.set_value(writer->write(7)); });
+        auto result = written.get_future();
+        assert(result.wait_for(std::chrono::milliseconds(50)) == std::future_status::timeout);
+        to_reader->deliver(reader);
+        assert(reader->read(data) && data.asInt() == 2);
+        assert(reader->read(data) && data.asInt() == 3);
+        to_writer->deliver(writer);
+        assert(result.get());
+        blocked.join();
+    }
+
+    // 超出信用的数据帧：接收方以RCODE_INVALID_MSG结束整个流
+    {
+        auto to_writer = std::make_shared<Wire>();
+        auto reader = std::make_shared<StreamChannel>(to_writer, "s", 2, 2);
+        RCode completed = RCode::RCODE_OK;
+        reader->setCompleteCallback([&completed](RCode code)
+                                    { completed = code; });
+        for (int i = 0; i < 3; ++i)
+            reader->onFrame(frame(R"({"rcode":0,"frame":0,"data":1})"));
+        assert(reader->rcode() == RCode::RCODE_INVALID_MSG);
+        assert(completed == RCode::RCODE_INVALID_MSG);
+        auto end = to_writer->last();
+        assert(end && end->frameType() == FrameType::END && end->rcode() == RCode::RCODE_INVALID_MSG);
+        Json::Value data;
+        assert(reader->read(data) && reader->read(data) && reader->read(data) == false);
+    }
+
+    // 非正数与溢出的信用同样是协议错误，信用保持不变
+    const char *bad_credits[] = {
+        R"({"rcode":0,"frame":1,"credit":0})",
+        R"({"rcode":0,"frame":1,"credit":-5})",
+        R"({"rcode":0,"frame":1,"credit":"x"})",
+        R"({"rcode":0,"frame":1,"credit":2147483647})",
+        R"({"rcode":0,"frame":"x"})",
+    };
+    for (auto body : bad_credits)
+    {
+        auto wire = std::make_shared<Wire>();
+        auto writer = std::make_shared<StreamChannel>(wire, "s", 2, 4);
+        writer->onFrame(frame(body));
+        assert(writer->credit() == 4);
+        assert(writer->rcode() == RCode::RCODE_INVALID_MSG);
+        assert(writer->tryWrite(1) == false);
+    }
+
+    std::cout << "testStream passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,93 @@
+/**
+ * @file test.cpp
+ * @brief 时间轮：ticks个tick内没有收发的连接被关闭，有收发或有未结束请求的连接保留
+ */
+#include "../../common/MuduoTool.hpp"
+#include "../common/FakeConn.hpp"
+#include <cassert>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace suprpc;
+using namespace suprpc::test;
+using muduo::net::TcpConnection;
+using muduo::net::TcpConnectionPtr;
+
+struct Peer
+{
+    TcpConnectionPtr conn;
+    FakeConn::ptr ctx;      // 连接上下文，pending即未结束的请求数
+    int remote = -1;        // socketpair的另一端
+    TimingWheel::WeakEntryPtr entry;
+};
+
+static Peer open(muduo::net::EventLoop &loop, const std::string &name)
+{
+    int fds[2];
+    assert(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    Peer peer;
+    peer.remote = fds[1];
+    peer.ctx = std::make_shared<FakeConn>();
+    peer.conn = std::make_shared<TcpConnection>(&loop, name, fds[0],
+                                                muduo::net::InetAddress(), muduo::net::InetAddress());
+    peer.conn->setContext(BaseConnection::ptr(peer.ctx));
+    peer.conn->setConnectionCallback([](const TcpConnectionPtr &) {});
+    peer.conn->setCloseCallback([&loop](const TcpConnectionPtr &conn)
+                                { loop.queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn)); });
+    peer.conn->connectEstablished();
+    return peer;
+}
+
+int main()
+{
+    init_logger(false, "", spdlog::level::level_enum::critical);
+
+    muduo::net::EventLoop loop;
+    TimingWheel wheel;
+    wheel.setTicks(3);
+
+    Peer idle = open(loop, "idle");
+    Peer busy = open(loop, "busy");
+    Peer active = open(loop, "active");
+    for (Peer *peer : {&idle, &busy, &active})
+        peer->entry = wheel.add(peer->conn);
+    busy.ctx->addPending(1);
+
+    // 转满一圈：没有收发的连接被关闭，仍有未结束请求的连接放回时间轮，期间有收发的连接保留
+    for (int i = 0; i < 3; ++i)
+    {
+        wheel.tick();
+        if (i < 2)
+            wheel.touch(active.entry);
+    }
+    assert(idle.conn->connected() == false && idle.entry.expired());
+    assert(busy.conn->connected() && busy.entry.expired() == false);
+    assert(active.conn->connected());
+
+    // 请求结束后不再受保护；不再收发的连接在最后一次收发的ticks个tick后关闭
+    busy.ctx->addPending(-1);
+    wheel.tick();
+    wheel.tick();
+    assert(active.conn->connected() == false);
+    assert(busy.conn->connected());
+    wheel.tick();
+    assert(busy.conn->connected() == false);
+
+    // 未开启时不记录也不关闭
+    TimingWheel disabled;
+    Peer kept = open(loop, "kept");
+    assert(disabled.add(kept.conn).expired());
+    disabled.tick();
+    assert(kept.conn->connected());
+    kept.conn->forceClose();
+
+    // 让事件循环完成关闭流程后再释放连接
+    loop.runAfter(0.1, [&loop]()
+                  { loop.quit(); });
+    loop.loop();
+    for (Peer *peer : {&idle, &busy, &active, &kept})
+        ::close(peer->remote);
+
+    std::cout << "testTimingWheel passed" << std::endl;
+    return 0;
+}